@@ -0,0 +1,84 @@
+/*
+	Undoing the Cardboard lens distortion: fitting the inverse polynomial once,
+	against what a renderer otherwise does for every vertex or pixel (solve
+	the forward polynomial with Newton's method) and what it does with the
+	fit (one polynomial evaluation).
+
+	The lens is the Cardboard I/O 2015 viewer, the one in the default QR code.
+*/
+
+#include "InverseDistortion.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	const std::vector<float> Forward = { 0.246483296f, 0.260026455f };
+	// Lens centre to the farthest corner of the viewport, tan-angle
+	const double MaxRadius = 1.4;
+	const int Radii = 64 * 64;
+
+	std::vector<double> screenRadii()
+	{
+		std::vector<double> radii(Radii);
+		for (int i = 0; i < Radii; i++) {
+			radii[i] = MaxRadius * i / (Radii - 1);
+		}
+		return radii;
+	}
+
+	void fit(benchmark::State& state)
+	{
+		InverseDistortionConfig config;
+		config.order = (int)state.range(0);
+		InverseDistortion result;
+		for (auto _ : state) {
+			result = fitInverseDistortion(Forward, MaxRadius, config);
+			benchmark::DoNotOptimize(result);
+		}
+		state.counters["max_error_deg"] = atan(result.maxError) * 180 / 3.14159265358979;
+	}
+
+	void newton(benchmark::State& state)
+	{
+		std::vector<double> radii = screenRadii();
+		std::vector<double> forward(Forward.begin(), Forward.end());
+		for (auto _ : state) {
+			for (double screen : radii) {
+				double image = screen;
+				for (int step = 0; step < (int)state.range(0); step++) {
+					double r2 = image * image;
+					double f = evaluateDistortion(forward, image) - screen;
+					double slope = 1 + 3 * forward[0] * r2 + 5 * forward[1] * r2 * r2;
+					image -= f / slope;
+				}
+				benchmark::DoNotOptimize(image);
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * Radii);
+	}
+
+	void fitted(benchmark::State& state)
+	{
+		InverseDistortionConfig config;
+		config.order = (int)state.range(0);
+		std::vector<double> inverse = fitInverseDistortion(Forward, MaxRadius, config).coefficients;
+		std::vector<double> radii = screenRadii();
+		for (auto _ : state) {
+			for (double screen : radii) {
+				benchmark::DoNotOptimize(evaluateDistortion(inverse, screen));
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * Radii);
+	}
+}
+
+BENCHMARK(fit)->DenseRange(2, 8, 2);
+BENCHMARK(newton)->Arg(4)->Arg(8);
+BENCHMARK(fitted)->DenseRange(2, 8, 2);
+
+BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,99 @@
+/*
+	The filter stage between the TrackingServer and the tracker send: batch
+	validation and renormalization alone, and with One Euro smoothing, over
+	noisy 200Hz head motion. Besides the time per sample, reports the jitter
+	(RMS of the second difference of the rotation, degrees) before and after
+	and how far the output lags the true motion (RMS degrees), to check that
+	the noise goes down without the lag going up much.
+*/
+
+#include "OrientationFilter.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	const int Samples = 256;
+	const double Rate = 200;
+	// Gyro noise as the phone's own fusion passes it on, radians
+	const double Noise = 0.002;
+
+	Quat truth(double t)
+	{
+		double yaw = 0.6 * sin(2 * 3.14159 * 0.3 * t);
+		double pitch = 0.2 * sin(2 * 3.14159 * 0.7 * t);
+		return quatMultiply(quatExp(Vec3{ 0, yaw, 0 }), quatExp(Vec3{ pitch, 0, 0 }));
+	}
+
+	std::vector<TimestampedQuaternion> noisyMotion(int batches)
+	{
+		std::mt19937 rng(7);
+		std::normal_distribution<double> noise(0, Noise);
+		std::vector<TimestampedQuaternion> samples(batches * Samples);
+		for (size_t i = 0; i < samples.size(); i++) {
+			double t = i / Rate;
+			Quat q = quatMultiply(truth(t), quatExp(Vec3{ noise(rng), noise(rng), noise(rng) }));
+			// Unnormalized and in either hemisphere, as phones send them
+			double scale = (i % 2 ? -1 : 1) * (1 + noise(rng));
+			samples[i].quaternion = toOsvr(Quat{ q.w * scale, q.x * scale, q.y * scale, q.z * scale });
+			samples[i].timestamp = fromMicroseconds((int64_t)(t * 1e6));
+		}
+		return samples;
+	}
+
+	double jitter(const std::vector<TimestampedQuaternion>& samples)
+	{
+		double sum = 0;
+		for (size_t i = 2; i < samples.size(); i++) {
+			Quat a = toQuat(samples[i - 2].quaternion), b = toQuat(samples[i - 1].quaternion), c = toQuat(samples[i].quaternion);
+			Vec3 first = quatLog(quatMultiply(quatConjugate(a), b));
+			Vec3 second = quatLog(quatMultiply(quatConjugate(b), c));
+			double dx = second.x - first.x, dy = second.y - first.y, dz = second.z - first.z;
+			sum += dx * dx + dy * dy + dz * dz;
+		}
+		return sqrt(sum / (samples.size() - 2)) * 180 / 3.14159;
+	}
+
+	double lag(const std::vector<TimestampedQuaternion>& samples)
+	{
+		double sum = 0;
+		for (size_t i = 0; i < samples.size(); i++) {
+			Vec3 error = quatLog(quatMultiply(quatConjugate(truth(i / Rate)), toQuat(samples[i].quaternion)));
+			sum += error.x * error.x + error.y * error.y + error.z * error.z;
+		}
+		return sqrt(sum / samples.size()) * 180 / 3.14159;
+	}
+
+	void filter(benchmark::State& state)
+	{
+		FilterConfig config;
+		config.enabled = state.range(0) != 0;
+		const int batches = 64;
+		std::vector<TimestampedQuaternion> input = noisyMotion(batches);
+		std::vector<TimestampedQuaternion> samples;
+
+		for (auto _ : state) {
+			state.PauseTiming();
+			samples = input;
+			OrientationFilter orientationFilter(config);
+			state.ResumeTiming();
+			for (int batch = 0; batch < batches; batch++) {
+				benchmark::DoNotOptimize(orientationFilter.process(samples.data() + batch * Samples, Samples));
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * batches * Samples);
+		state.counters["jitter_in"] = jitter(input);
+		state.counters["jitter_out"] = jitter(samples);
+		state.counters["error_in"] = lag(input);
+		state.counters["error_out"] = lag(samples);
+	}
+}
+
+BENCHMARK(filter)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
\ No newline at end of file
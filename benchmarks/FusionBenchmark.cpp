@@ -0,0 +1,61 @@
+/*
+	Server-side IMU fusion: the cost of one raw sample through the Mahony
+	filter, with the filter stepping 1 to 16 phones together. Every phone sends
+	at 1kHz with a magnetometer, so the per sample cost should fall as lanes
+	are added and the step vectorizes.
+*/
+
+#include "ImuFusion.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	const int Batch = 16;
+
+	ImuSample sample(int lane, int i)
+	{
+		double t = i * 0.001;
+		ImuSample s;
+		s.timestamp = (int64_t)(t * 1e6);
+		s.gyro[0] = 0.2f * (float)sin(3 * t + lane);
+		s.gyro[1] = 0.5f * (float)cos(2 * t);
+		s.gyro[2] = 0.01f;
+		s.accel[0] = 0.3f;
+		s.accel[1] = 9.8f;
+		s.accel[2] = -0.2f;
+		s.magnet[0] = 20;
+		s.magnet[1] = -40;
+		s.magnet[2] = 5;
+		s.hasMagnet = true;
+		return s;
+	}
+
+	void fuse(benchmark::State& state)
+	{
+		int lanes = (int)state.range(0);
+		ImuFusion fusion;
+		fusion.configure(lanes, FusionConfig());
+		std::vector<FusedSample> out;
+		int i = 0;
+		for (auto _ : state) {
+			for (int n = 0; n < Batch; n++, i++) {
+				for (int lane = 0; lane < lanes; lane++) {
+					fusion.add(lane, sample(lane, i), 0);
+				}
+			}
+			out.clear();
+			fusion.process(out);
+			benchmark::DoNotOptimize(out.data());
+		}
+		state.SetItemsProcessed(state.iterations() * Batch * lanes);
+	}
+}
+
+BENCHMARK(fuse)->Arg(1)->Arg(4)->Arg(16);
+
+BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,188 @@
+/*
+	TrackingServer scaling with the number of connected phones. Each simulated
+	phone streams orientation lines over loopback TCP as fast as it can, a few
+	lines per write the way a phone's network stack coalesces them, while the
+	main thread drains every sensor the way the update callback does.
+
+	Streaming flat out makes the network thread the bottleneck, so aggregate
+	throughput should hold steady as phones are added, with no per client
+	overhead eating into it. At a phone's real rate of a few hundred Hz that
+	leaves every phone far more headroom than it needs.
+*/
+
+#include "TrackingServer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	const int LinesPerPhone = 20000;
+	const int LinesPerWrite = 4;
+
+	TrackingServer& server()
+	{
+		static std::unique_ptr<TrackingServer> instance = [] {
+			TrackingConfig config;
+			config.sensors = TS_MAX_SENSORS;
+			// Room for a whole iteration, so a consumer that gets descheduled
+			// doesn't turn into drops
+			config.queue.capacity = LinesPerPhone;
+			return std::unique_ptr<TrackingServer>(new TrackingServer(config));
+		}();
+		return *instance;
+	}
+
+	// 1kHz of rotation about the vertical axis, pre-formatted into writes
+	std::vector<std::string> synthesizeWrites()
+	{
+		std::vector<std::string> writes;
+		std::string write;
+		char line[256];
+		long long seconds = 1476000000;
+		long microseconds = 0;
+
+		for (int i = 0; i < LinesPerPhone; i++) {
+			double half = 0.5 * sin(i / 1000.0);
+			snprintf(line, sizeof(line), "{\"x\":0,\"y\":%.9f,\"z\":0,\"w\":%.9f,\"s\":%lld,\"m\":%ld}\n",
+				sin(half), cos(half), seconds, microseconds);
+			write += line;
+			if ((i + 1) % LinesPerWrite == 0) {
+				writes.push_back(write);
+				write.clear();
+			}
+
+			microseconds += 1000;
+			if (microseconds >= 1000000) {
+				microseconds -= 1000000;
+				seconds++;
+			}
+		}
+		if (!write.empty()) {
+			writes.push_back(write);
+		}
+		return writes;
+	}
+
+	bool waitForClients(int count)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (server().clientCount() != count) {
+			if (std::chrono::steady_clock::now() > deadline) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	// Retries for a while, the server may still be starting up
+	SOCKET connectPhone()
+	{
+		SOCKADDR_IN address = SOCKADDR_IN();
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(OSVR_CARDBOARD_PORT);
+
+		for (int attempt = 0; attempt < 100; attempt++) {
+			SOCKET phone = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (phone == INVALID_SOCKET) break;
+			if (connect(phone, (SOCKADDR*)&address, sizeof(address)) != SOCKET_ERROR) {
+				return phone;
+			}
+			closesocket(phone);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return INVALID_SOCKET;
+	}
+
+	void stream(SOCKET phone, const std::vector<std::string>& writes)
+	{
+		for (const std::string& write : writes) {
+			size_t sent = 0;
+			while (sent < write.size()) {
+				int result = net::send(phone, write.data() + sent, (int)(write.size() - sent));
+				if (result == SOCKET_ERROR) return;
+				sent += result;
+			}
+		}
+	}
+
+	uint64_t totalDropped(int phones)
+	{
+		uint64_t dropped = 0;
+		for (int sensor = 0; sensor < phones; sensor++) {
+			dropped += server().droppedQuaternions(sensor);
+		}
+		return dropped;
+	}
+
+	void phones(benchmark::State& state)
+	{
+		static const std::vector<std::string> writes = synthesizeWrites();
+		int count = (int)state.range(0);
+		server();
+
+		std::vector<SOCKET> sockets;
+		for (int i = 0; i < count; i++) {
+			sockets.push_back(connectPhone());
+		}
+		if (!waitForClients(count)) {
+			state.SkipWithError("Phones didn't connect");
+		}
+
+		std::vector<TimestampedQuaternion> samples;
+		uint64_t received = 0;
+		uint64_t droppedBefore = totalDropped(count);
+
+		for (auto _ : state) {
+			if (!state.error_occurred()) {
+				uint64_t expected = received + (uint64_t)count * LinesPerPhone;
+				auto start = std::chrono::steady_clock::now();
+				auto deadline = start + std::chrono::seconds(10);
+
+				std::vector<std::thread> threads;
+				for (SOCKET phone : sockets) {
+					threads.emplace_back(stream, phone, std::cref(writes));
+				}
+
+				// Consume like the update callback, until everything sent is accounted for
+				while (received + totalDropped(count) - droppedBefore < expected) {
+					for (int sensor = 0; sensor < count; sensor++) {
+						received += server().drain(samples, sensor);
+					}
+					std::this_thread::yield();
+					if (std::chrono::steady_clock::now() > deadline) {
+						state.SkipWithError("Samples went missing");
+						break;
+					}
+				}
+				auto end = std::chrono::steady_clock::now();
+
+				for (std::thread& thread : threads) {
+					thread.join();
+				}
+				state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+			}
+		}
+
+		for (SOCKET phone : sockets) {
+			net::closeSocket(phone);
+		}
+		waitForClients(0);
+
+		state.SetItemsProcessed((int64_t)received);
+		state.counters["per_phone"] = benchmark::Counter((double)received / count, benchmark::Counter::kIsRate);
+		state.counters["dropped"] = (double)(totalDropped(count) - droppedBefore);
+	}
+}
+
+BENCHMARK(phones)->RangeMultiplier(2)->Range(1, TS_MAX_SENSORS)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
\ No newline at end of file
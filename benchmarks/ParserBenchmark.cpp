@@ -0,0 +1,159 @@
+/*
+	Orientation line parsing: the hand written parser against the old
+	sscanf + jsoncpp fallback and against jsoncpp alone.
+
+	Set OSVR_CARDBOARD_STREAM to a file of recorded lines to benchmark those
+	instead of the synthetic head motion stream.
+*/
+
+#include "OrientationParser.h"
+
+#include <benchmark/benchmark.h>
+#include <json/json.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	// 200Hz of slow head motion with a clock sync every 100 samples, formatted
+	// the way the phone app writes it
+	std::vector<std::string> synthesizeStream()
+	{
+		std::vector<std::string> lines;
+		char line[256];
+		long long seconds = 1476000000;
+		long microseconds = 0;
+
+		for (int i = 0; i < 10000; i++) {
+			double t = i / 200.0;
+			double yaw = 0.6 * sin(2 * 3.14159 * 0.3 * t);
+			double pitch = 0.2 * sin(2 * 3.14159 * 0.7 * t);
+			double cy = cos(yaw / 2), sy = sin(yaw / 2), cp = cos(pitch / 2), sp = sin(pitch / 2);
+
+			snprintf(line, sizeof(line), "{\"x\":%.17g,\"y\":%.17g,\"z\":%.17g,\"w\":%.17g,\"s\":%lld,\"m\":%ld}",
+				sp * cy, cp * sy, -sp * sy, cp * cy, seconds, microseconds);
+			lines.push_back(line);
+
+			if (i % 100 == 0) {
+				snprintf(line, sizeof(line), "{\"s\":%lld,\"m\":%ld}", seconds, microseconds);
+				lines.push_back(line);
+			}
+
+			microseconds += 5000;
+			if (microseconds >= 1000000) {
+				microseconds -= 1000000;
+				seconds++;
+			}
+		}
+		return lines;
+	}
+
+	const std::vector<std::string>& stream()
+	{
+		static std::vector<std::string> lines = [] {
+			const char* path = getenv("OSVR_CARDBOARD_STREAM");
+			if (!path) {
+				return synthesizeStream();
+			}
+			std::vector<std::string> recorded;
+			std::ifstream file(path);
+			for (std::string line; std::getline(file, line);) {
+				recorded.push_back(line);
+			}
+			return recorded;
+		}();
+		return lines;
+	}
+
+	int parseFast(const std::string& line)
+	{
+		return (int)parseLine(line).type;
+	}
+
+	// What TrackingServer::net_thread did before the dedicated parser
+	int parseSscanf(const std::string& line)
+	{
+		double x, y, z, w;
+		long long s;
+		long m;
+
+		if (6 == sscanf(line.c_str(), "{\"x\":%lf,\"y\":%lf,\"z\":%lf,\"w\":%lf,\"s\":%lld,\"m\":%ld}", &x, &y, &z, &w, &s, &m)) {
+			benchmark::DoNotOptimize(x + y + z + w);
+			return 0;
+		}
+		if (2 == sscanf(line.c_str(), "{\"s\":%lld,\"m\":%ld}", &s, &m)) {
+			return 1;
+		}
+		Json::Value json;
+		Json::Reader reader;
+		reader.parse(line, json);
+		return 2;
+	}
+
+	int parseJsonCpp(const std::string& line)
+	{
+		Json::Value json;
+		Json::Reader reader;
+		if (!reader.parse(line, json)) return 3;
+		if (json.isMember("x")) {
+			benchmark::DoNotOptimize(json["x"].asDouble() + json["y"].asDouble() + json["z"].asDouble() + json["w"].asDouble());
+			return 0;
+		}
+		return json.isMember("s") ? 1 : 2;
+	}
+
+	template <typename Parser>
+	void throughput(benchmark::State& state, Parser parser)
+	{
+		const std::vector<std::string>& lines = stream();
+		for (auto _ : state) {
+			for (const std::string& line : lines) {
+				benchmark::DoNotOptimize(parser(line));
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * lines.size());
+	}
+
+	// Per line timing, including clock overhead, reported as percentiles
+	template <typename Parser>
+	void latency(benchmark::State& state, Parser parser)
+	{
+		const std::vector<std::string>& lines = stream();
+		std::vector<double> nanoseconds;
+		nanoseconds.reserve(lines.size());
+
+		for (auto _ : state) {
+			nanoseconds.clear();
+			for (const std::string& line : lines) {
+				auto start = std::chrono::steady_clock::now();
+				benchmark::DoNotOptimize(parser(line));
+				auto end = std::chrono::steady_clock::now();
+				nanoseconds.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+			}
+		}
+
+		std::sort(nanoseconds.begin(), nanoseconds.end());
+		state.counters["p50_ns"] = nanoseconds[nanoseconds.size() / 2];
+		state.counters["p99_ns"] = nanoseconds[nanoseconds.size() * 99 / 100];
+		state.counters["p999_ns"] = nanoseconds[nanoseconds.size() * 999 / 1000];
+		state.counters["max_ns"] = nanoseconds.back();
+	}
+}
+
+BENCHMARK_CAPTURE(throughput, parseLine, parseFast);
+BENCHMARK_CAPTURE(throughput, sscanf, parseSscanf);
+BENCHMARK_CAPTURE(throughput, jsoncpp, parseJsonCpp);
+
+BENCHMARK_CAPTURE(latency, parseLine, parseFast);
+BENCHMARK_CAPTURE(latency, sscanf, parseSscanf);
+BENCHMARK_CAPTURE(latency, jsoncpp, parseJsonCpp);
+
+BENCHMARK_MAIN();
\ No newline at end of file
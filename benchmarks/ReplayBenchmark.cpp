@@ -0,0 +1,66 @@
+/*
+	The whole receive path (framing, parsing, clock translation, queueing and
+	draining) fed from a recorded session log as fast as it will go, so that
+	pipeline changes can be compared on real head motion.
+
+	Set OSVR_CARDBOARD_SESSION to a log recorded with tracking.session.record
+	in the device descriptor, or with the phone emulator's --record option.
+*/
+
+#include "TrackingServer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	void replay(benchmark::State& state)
+	{
+		const char* path = getenv("OSVR_CARDBOARD_SESSION");
+		if (!path) {
+			state.SkipWithError("Set OSVR_CARDBOARD_SESSION to a recorded session log");
+			return;
+		}
+
+		TrackingConfig config;
+		config.sensors = TS_MAX_SENSORS;
+		config.session.replay = path;
+		config.session.realtime = false;
+		// Replay outruns any drain loop, give it room so drops don't hide work
+		config.queue.capacity = 1 << 16;
+
+		std::vector<TimestampedQuaternion> samples;
+		uint64_t delivered = 0;
+		uint64_t dropped = 0;
+
+		for (auto _ : state) {
+			TrackingServer server(config);
+			do {
+				for (int sensor = 0; sensor < TS_MAX_SENSORS; sensor++) {
+					delivered += server.drain(samples, sensor);
+				}
+				std::this_thread::yield();
+			} while (!server.replayFinished() && !server.hasError());
+
+			if (server.hasError()) {
+				state.SkipWithError(server.getError());
+				break;
+			}
+			for (int sensor = 0; sensor < TS_MAX_SENSORS; sensor++) {
+				delivered += server.drain(samples, sensor);
+				dropped += server.droppedQuaternions(sensor);
+			}
+		}
+
+		state.SetItemsProcessed((int64_t)delivered);
+		state.counters["dropped"] = (double)dropped;
+	}
+}
+
+BENCHMARK(replay)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,220 @@
+/*
+	Viewer params ingest, the base64url text from a Cardboard QR code to a
+	DeviceParams: the table driven codec and arena parse against the old
+	per-character alphabet search and heap parse.
+
+	Every payload is round tripped (decode, encode, and decode, parse,
+	serialize, encode) before anything is timed, and the run is skipped if
+	any of them don't come back identical.
+
+	Set OSVR_CARDBOARD_PAYLOADS to a file of payloads, one per line, to
+	benchmark those instead of the Cardboard I/O 2015 viewer's.
+*/
+
+#include "Base64.h"
+#include "Viewer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	const char* CardboardIO2015 = "CgZHb29nbGUSEkNhcmRib2FyZCBJL08gMjAxNR2ZuxY9JbbzfT0qEAAASEIAAEhCAABIQgAASEJYADUpXA89OggeZnw-MCKFPlAAYAM";
+
+	std::vector<std::string> loadPayloads()
+	{
+		std::vector<std::string> payloads;
+		const char* path = getenv("OSVR_CARDBOARD_PAYLOADS");
+		if (path) {
+			std::ifstream file(path);
+			std::string line;
+			while (std::getline(file, line)) {
+				while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+					line.pop_back();
+				}
+				if (!line.empty()) {
+					payloads.push_back(line);
+				}
+			}
+		}
+		if (payloads.empty()) {
+			payloads.push_back(CardboardIO2015);
+		}
+		return payloads;
+	}
+
+	const std::vector<std::string>& payloads()
+	{
+		static const std::vector<std::string> loaded = loadPayloads();
+		return loaded;
+	}
+
+	// How Viewer decoded before: a search of the alphabet for every
+	// character, and the output appended a byte at a time
+	std::string legacyDecode(const std::string& encoded)
+	{
+		static const std::string alphabet =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+			"abcdefghijklmnopqrstuvwxyz"
+			"0123456789-_";
+		std::string decoded;
+		uint32_t bits = 0;
+		int count = 0;
+		for (char c : encoded) {
+			size_t value = alphabet.find(c);
+			if (c == '=' || value == std::string::npos) break;
+			bits = bits << 6 | (uint32_t)value;
+			if (++count == 4) {
+				decoded += (char)(bits >> 16);
+				decoded += (char)(bits >> 8);
+				decoded += (char)bits;
+				bits = 0;
+				count = 0;
+			}
+		}
+		if (count > 1) {
+			bits <<= 6 * (4 - count);
+			decoded += (char)(bits >> 16);
+			if (count > 2) decoded += (char)(bits >> 8);
+		}
+		return decoded;
+	}
+
+	std::string stripPadding(std::string text)
+	{
+		while (!text.empty() && text.back() == '=') {
+			text.pop_back();
+		}
+		return text;
+	}
+
+	std::string encode(const std::string& data)
+	{
+		std::string text(base64url::encodedLength(data.size()), '\0');
+		base64url::encode((const uint8_t*)data.data(), data.size(), &text[0]);
+		return text;
+	}
+
+	// Empty if every payload survives both round trips
+	std::string roundTripFailure()
+	{
+		for (const std::string& payload : payloads()) {
+			std::vector<uint8_t> buffer(base64url::maxDecodedLength(payload.size()));
+			ptrdiff_t length = base64url::decode(payload, buffer.data());
+			if (length < 0) {
+				return "Doesn't decode: " + payload;
+			}
+			std::string decoded((const char*)buffer.data(), length);
+			if (decoded != legacyDecode(payload)) {
+				return "Decodes differently to before: " + payload;
+			}
+			if (encode(decoded) != stripPadding(payload)) {
+				return "Doesn't encode back: " + payload;
+			}
+
+			google::protobuf::Arena arena;
+			DeviceParams* params = Viewer::decodeViewerParams(payload, &arena);
+			if (!params) {
+				return "Doesn't parse: " + payload;
+			}
+			DeviceParams reparsed;
+			if (!reparsed.ParseFromString(legacyDecode(encode(params->SerializeAsString()))) ||
+				reparsed.SerializeAsString() != params->SerializeAsString()) {
+				return "Doesn't survive serialization: " + payload;
+			}
+		}
+		return "";
+	}
+
+	bool checkRoundTrips(benchmark::State& state)
+	{
+		static const std::string failure = roundTripFailure();
+		if (!failure.empty()) {
+			state.SkipWithError(failure.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void decodeLegacy(benchmark::State& state)
+	{
+		if (!checkRoundTrips(state)) return;
+		for (auto _ : state) {
+			for (const std::string& payload : payloads()) {
+				benchmark::DoNotOptimize(legacyDecode(payload));
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * payloads().size());
+	}
+
+	void decodeTable(benchmark::State& state)
+	{
+		if (!checkRoundTrips(state)) return;
+		uint8_t buffer[VIEWER_PARAMS_STACK_SIZE];
+		for (auto _ : state) {
+			for (const std::string& payload : payloads()) {
+				if (base64url::maxDecodedLength(payload.size()) > sizeof(buffer)) continue;
+				benchmark::DoNotOptimize(base64url::decode(payload, buffer));
+				benchmark::ClobberMemory();
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * payloads().size());
+	}
+
+	void encodeTable(benchmark::State& state)
+	{
+		if (!checkRoundTrips(state)) return;
+		std::vector<std::string> decoded;
+		for (const std::string& payload : payloads()) {
+			decoded.push_back(legacyDecode(payload));
+		}
+		char text[VIEWER_PARAMS_STACK_SIZE * 2];
+		for (auto _ : state) {
+			for (const std::string& data : decoded) {
+				if (base64url::encodedLength(data.size()) > sizeof(text)) continue;
+				benchmark::DoNotOptimize(base64url::encode((const uint8_t*)data.data(), data.size(), text));
+				benchmark::ClobberMemory();
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * payloads().size());
+	}
+
+	void ingestLegacy(benchmark::State& state)
+	{
+		if (!checkRoundTrips(state)) return;
+		for (auto _ : state) {
+			for (const std::string& payload : payloads()) {
+				DeviceParams params;
+				benchmark::DoNotOptimize(params.ParseFromString(legacyDecode(payload)));
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * payloads().size());
+	}
+
+	void ingestArena(benchmark::State& state)
+	{
+		if (!checkRoundTrips(state)) return;
+		google::protobuf::Arena arena;
+		for (auto _ : state) {
+			for (const std::string& payload : payloads()) {
+				benchmark::DoNotOptimize(Viewer::decodeViewerParams(payload, &arena));
+			}
+			// The way a bulk tool would, once per batch
+			arena.Reset();
+		}
+		state.SetItemsProcessed(state.iterations() * payloads().size());
+	}
+}
+
+BENCHMARK(decodeLegacy);
+BENCHMARK(decodeTable);
+BENCHMARK(encodeTable);
+BENCHMARK(ingestLegacy);
+BENCHMARK(ingestArena);
+
+BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "Base64.h"
+
+namespace OSVRCardboard {
+	namespace base64url {
+		namespace {
+			const char Alphabet[] =
+				"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+				"abcdefghijklmnopqrstuvwxyz"
+				"0123456789-_";
+
+			// Six bit value for each character, 0xff for anything else
+			struct DecodeTable {
+				uint8_t values[256];
+
+				constexpr DecodeTable() : values()
+				{
+					for (int i = 0; i < 256; i++) {
+						values[i] = 0xff;
+					}
+					for (int i = 0; i < 64; i++) {
+						values[(uint8_t)Alphabet[i]] = (uint8_t)i;
+					}
+				}
+			};
+
+			constexpr DecodeTable Table;
+		}
+
+		ptrdiff_t decode(std::string_view encoded, uint8_t* out)
+		{
+			size_t length = encoded.size();
+			while (length > 0 && encoded[length - 1] == '=') {
+				length--;
+			}
+			if (length % 4 == 1 || encoded.size() - length > 2) {
+				return -1;
+			}
+
+			const uint8_t* in = (const uint8_t*)encoded.data();
+			uint8_t* start = out;
+			size_t whole = length / 4 * 4;
+
+			// Any invalid character sets the top bits of bad, checked once at
+			// the end rather than per character
+			uint32_t bad = 0;
+			for (size_t i = 0; i < whole; i += 4) {
+				uint32_t a = Table.values[in[i]];
+				uint32_t b = Table.values[in[i + 1]];
+				uint32_t c = Table.values[in[i + 2]];
+				uint32_t d = Table.values[in[i + 3]];
+				bad |= a | b | c | d;
+				uint32_t bits = a << 18 | b << 12 | c << 6 | d;
+				out[0] = (uint8_t)(bits >> 16);
+				out[1] = (uint8_t)(bits >> 8);
+				out[2] = (uint8_t)bits;
+				out += 3;
+			}
+
+			size_t rest = length - whole;
+			if (rest > 0) {
+				uint32_t a = Table.values[in[whole]];
+				uint32_t b = Table.values[in[whole + 1]];
+				uint32_t c = rest > 2 ? Table.values[in[whole + 2]] : 0;
+				bad |= a | b | c;
+				uint32_t bits = a << 18 | b << 12 | c << 6;
+				*out++ = (uint8_t)(bits >> 16);
+				if (rest > 2) {
+					*out++ = (uint8_t)(bits >> 8);
+				}
+			}
+
+			if (bad & 0xc0) {
+				return -1;
+			}
+			return out - start;
+		}
+
+		size_t encode(const uint8_t* data, size_t length, char* out)
+		{
+			char* start = out;
+			size_t whole = length / 3 * 3;
+			for (size_t i = 0; i < whole; i += 3) {
+				uint32_t bits = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+				out[0] = Alphabet[bits >> 18];
+				out[1] = Alphabet[(bits >> 12) & 0x3f];
+				out[2] = Alphabet[(bits >> 6) & 0x3f];
+				out[3] = Alphabet[bits & 0x3f];
+				out += 4;
+			}
+
+			size_t rest = length - whole;
+			if (rest > 0) {
+				uint32_t bits = (uint32_t)data[whole] << 16;
+				if (rest > 1) {
+					bits |= (uint32_t)data[whole + 1] << 8;
+				}
+				*out++ = Alphabet[bits >> 18];
+				*out++ = Alphabet[(bits >> 12) & 0x3f];
+				if (rest > 1) {
+					*out++ = Alphabet[(bits >> 6) & 0x3f];
+				}
+			}
+			return out - start;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace OSVRCardboard {
+	/// base64url (RFC 4648 section 5), the encoding Cardboard QR codes carry
+	/// viewer params in. Table driven, and writes into the caller's buffer
+	/// so decoding a payload allocates nothing.
+	namespace base64url {
+		/// Most bytes decoding this much text can produce
+		constexpr size_t maxDecodedLength(size_t encodedLength)
+		{
+			return encodedLength / 4 * 3 + (encodedLength % 4 ? 2 : 0);
+		}
+
+		/// Unpadded, as Cardboard writes it
+		constexpr size_t encodedLength(size_t length)
+		{
+			return length / 3 * 4 + (length % 3 ? length % 3 + 1 : 0);
+		}
+
+		/// Decodes into out, which must hold maxDecodedLength(encoded.size())
+		/// bytes. Trailing '=' padding is allowed but not needed. Returns the
+		/// number of bytes written, or -1 if the text isn't base64url.
+		ptrdiff_t decode(std::string_view encoded, uint8_t* out);
+
+		/// Writes encodedLength(length) characters to out, no padding
+		size_t encode(const uint8_t* data, size_t length, char* out);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "ClockEstimator.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace OSVRCardboard {
+
+	void ClockEstimator::addExchange(int64_t clientSend, int64_t serverReceive, int64_t serverSend, int64_t clientReceive)
+	{
+		double rtt = (double)(clientReceive - clientSend) - (double)(serverSend - serverReceive);
+		if (rtt < 0) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Sample& sample = m_exchanges[m_exchange_next];
+		sample.serverTime = serverReceive;
+		sample.offset = ((double)(serverReceive - clientSend) + (double)(serverSend - clientReceive)) / 2;
+		sample.rtt = rtt;
+
+		m_exchange_next = (m_exchange_next + 1) % TS_CLOCK_WINDOW;
+		if (m_exchange_count < TS_CLOCK_WINDOW) m_exchange_count++;
+		m_exchange_total++;
+
+		update();
+	}
+
+	void ClockEstimator::addOneWay(int64_t clientSend, int64_t serverReceive)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		double offset = (double)(serverReceive - clientSend);
+
+		if (m_bucket_open && serverReceive - m_bucket.serverTime < TS_CLOCK_BUCKET_US) {
+			// A new minimum matters straight away if there's nothing better to go on
+			if (offset < m_bucket.offset) {
+				m_bucket.offset = offset;
+				if (!m_exchange_count) update();
+			}
+			return;
+		}
+
+		if (m_bucket_open) {
+			m_envelope[m_envelope_next] = m_bucket;
+			m_envelope_next = (m_envelope_next + 1) % TS_CLOCK_WINDOW;
+			if (m_envelope_count < TS_CLOCK_WINDOW) m_envelope_count++;
+		}
+
+		m_bucket.serverTime = serverReceive;
+		m_bucket.offset = offset;
+		m_bucket.rtt = 0;
+		m_bucket_open = true;
+
+		update();
+	}
+
+	void ClockEstimator::update()
+	{
+		if (m_exchange_count) {
+			double rttMin = m_exchanges[0].rtt;
+			for (size_t i = 1; i < m_exchange_count; i++) {
+				rttMin = std::min(rttMin, m_exchanges[i].rtt);
+			}
+			// Exchanges that queued much longer than the fastest carry their
+			// queueing asymmetry straight into the offset, so leave them out
+			fit(m_exchanges, m_exchange_count, 2 * rttMin + 500);
+			m_round_trip = true;
+		}
+		else {
+			Sample samples[TS_CLOCK_WINDOW + 1];
+			std::copy(m_envelope, m_envelope + m_envelope_count, samples);
+			samples[m_envelope_count] = m_bucket;
+			fit(samples, m_envelope_count + 1, 0);
+			m_round_trip = false;
+		}
+		m_synchronised = true;
+	}
+
+	void ClockEstimator::fit(const Sample* samples, size_t count, double rttLimit)
+	{
+		double n = 0, sumT = 0, sumO = 0, sumTT = 0, sumTO = 0;
+		int64_t reference = samples[0].serverTime;
+		int64_t first = INT64_MAX, last = INT64_MIN;
+
+		for (size_t i = 0; i < count; i++) {
+			if (samples[i].rtt > rttLimit) continue;
+			double t = (double)(samples[i].serverTime - reference);
+			n++;
+			sumT += t;
+			sumO += samples[i].offset;
+			sumTT += t * t;
+			sumTO += t * samples[i].offset;
+			first = std::min(first, samples[i].serverTime);
+			last = std::max(last, samples[i].serverTime);
+		}
+		if (!n) {
+			return;
+		}
+
+		double meanT = sumT / n;
+		double meanO = sumO / n;
+		double varianceT = sumTT / n - meanT * meanT;
+
+		m_reference = reference + (int64_t)meanT;
+		m_offset = meanO;
+		// Drift is only meaningful over a few seconds of data
+		m_drift = (n >= 3 && last - first >= 2000000 && varianceT > 0)
+			? (sumTO / n - meanT * meanO) / varianceT
+			: 0;
+	}
+
+	int64_t ClockEstimator::toServer(int64_t clientTime)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_synchronised) {
+			return clientTime;
+		}
+		double approximateServerTime = clientTime + m_offset;
+		double offset = m_offset + m_drift * (approximateServerTime - m_reference);
+		return clientTime + (int64_t)offset;
+	}
+
+	OSVR_TimeValue ClockEstimator::toServer(const OSVR_TimeValue& clientTime)
+	{
+		return fromMicroseconds(toServer(toMicroseconds(clientTime)));
+	}
+
+	ClockStats ClockEstimator::stats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ClockStats stats = ClockStats();
+		stats.synchronised = m_synchronised;
+		stats.roundTrip = m_round_trip;
+		stats.offset = m_offset / 1e6;
+		stats.driftPpm = m_drift * 1e6;
+		stats.exchanges = m_exchange_total;
+
+		if (m_exchange_count) {
+			std::vector<double> rtts;
+			for (size_t i = 0; i < m_exchange_count; i++) {
+				rtts.push_back(m_exchanges[i].rtt / 1e6);
+			}
+			std::sort(rtts.begin(), rtts.end());
+			stats.rttMin = rtts.front();
+			stats.rttMedian = rtts[rtts.size() / 2];
+			stats.rttP90 = rtts[rtts.size() * 9 / 10];
+			stats.rttMax = rtts.back();
+		}
+		return stats;
+	}
+
+	void ClockEstimator::reset()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_exchange_count = m_exchange_next = 0;
+		m_exchange_total = 0;
+		m_envelope_count = m_envelope_next = 0;
+		m_bucket_open = false;
+		m_synchronised = false;
+		m_round_trip = false;
+		m_offset = m_drift = 0;
+		m_reference = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "TrackingTypes.h"
+
+#include <mutex>
+#include <cstdint>
+
+#define TS_CLOCK_WINDOW 64
+// One way samples are reduced to their minimum per bucket
+#define TS_CLOCK_BUCKET_US 1000000
+
+namespace OSVRCardboard {
+	struct ClockStats {
+		bool synchronised;
+		// True if the estimate comes from full round trips, not one way delays
+		bool roundTrip;
+		// Server minus client, seconds
+		double offset;
+		// Rate of change of the offset, parts per million
+		double driftPpm;
+		// Over the recent round trips, seconds
+		double rttMin;
+		double rttMedian;
+		double rttP90;
+		double rttMax;
+		uint64_t exchanges;
+	};
+
+	/// Estimates the offset (and drift) between a client's clock and ours.
+	///
+	/// Full NTP style exchanges are preferred: the offset is fitted over the
+	/// exchanges with the smallest round trip times, which are the least
+	/// skewed by queueing. Without any, every client timestamp we receive still
+	/// bounds the offset from one side, and the lower envelope of those (one
+	/// minimum per second) is used instead. That estimate includes the minimum
+	/// one way delay, which is usually a millisecond or two on a LAN.
+	class ClockEstimator {
+	public:
+		/// Times in microseconds: client send, server receive, server send,
+		/// client receive
+		void addExchange(int64_t clientSend, int64_t serverReceive, int64_t serverSend, int64_t clientReceive);
+		void addOneWay(int64_t clientSend, int64_t serverReceive);
+
+		int64_t toServer(int64_t clientTime);
+		OSVR_TimeValue toServer(const OSVR_TimeValue& clientTime);
+
+		ClockStats stats();
+		void reset();
+
+	private:
+		struct Sample {
+			int64_t serverTime;
+			double offset;
+			double rtt;
+		};
+
+		void update();
+		void fit(const Sample* samples, size_t count, double rttLimit);
+
+		std::mutex m_mutex;
+		Sample m_exchanges[TS_CLOCK_WINDOW];
+		size_t m_exchange_count = 0;
+		size_t m_exchange_next = 0;
+		uint64_t m_exchange_total = 0;
+
+		Sample m_envelope[TS_CLOCK_WINDOW];
+		size_t m_envelope_count = 0;
+		size_t m_envelope_next = 0;
+		Sample m_bucket;
+		bool m_bucket_open = false;
+
+		bool m_synchronised = false;
+		bool m_round_trip = false;
+		// offset(t) = m_offset + m_drift * (t - m_reference), all microseconds
+		double m_offset = 0;
+		double m_drift = 0;
+		int64_t m_reference = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "DistortionMesh.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace OSVRCardboard {
+	namespace {
+		// Generates rows [first, last) of the grid. The per row math is kept
+		// to flat float arrays with no branches, so it vectorizes.
+		void generateRows(const EyeLens& lens, int density, int first, int last, std::vector<MeshSample>& out)
+		{
+			std::vector<float> tx(density), ty(density), r2(density), scale(density);
+			const float step = 1.0f / (density - 1);
+			// Texture coordinate to tan-angle, and tan-angle to screen coordinate
+			const float tanPerX = (float)(lens.width / lens.projectionDistance);
+			const float tanPerY = (float)(lens.height / lens.projectionDistance);
+			const float xPerTan = (float)(lens.screenDistance / lens.width);
+			const float yPerTan = (float)(lens.screenDistance / lens.height);
+			const float cx = (float)lens.centerX;
+			const float cy = (float)lens.centerY;
+			const int terms = (int)lens.coefficients.size();
+			// Keep samples up to one grid step off the viewport, so the edges
+			// still interpolate
+			const float low = -step;
+			const float high = 1 + step;
+
+			for (int row = first; row < last; row++) {
+				const float v = row * step;
+				const float y = (v - cy) * tanPerY;
+
+				for (int i = 0; i < density; i++) {
+					tx[i] = (i * step - cx) * tanPerX;
+					ty[i] = y;
+					r2[i] = tx[i] * tx[i] + y * y;
+					scale[i] = 0;
+				}
+				// Horner's rule in r^2, highest coefficient first
+				for (int k = terms - 1; k >= 0; k--) {
+					const float coefficient = lens.coefficients[k];
+					for (int i = 0; i < density; i++) {
+						scale[i] = (scale[i] + coefficient) * r2[i];
+					}
+				}
+
+				for (int i = 0; i < density; i++) {
+					MeshSample sample;
+					sample.screen[0] = cx + tx[i] * (1 + scale[i]) * xPerTan;
+					sample.screen[1] = cy + ty[i] * (1 + scale[i]) * yPerTan;
+					sample.texture[0] = i * step;
+					sample.texture[1] = v;
+					if (sample.screen[0] >= low && sample.screen[0] <= high &&
+						sample.screen[1] >= low && sample.screen[1] <= high) {
+						out.push_back(sample);
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<MeshSample> generateDistortionMesh(const EyeLens& lens, const DistortionMeshConfig& config)
+	{
+		std::vector<MeshSample> mesh;
+		int density = config.density;
+		if (density < 2 || lens.width <= 0 || lens.height <= 0 ||
+			lens.screenDistance <= 0 || lens.projectionDistance <= 0) {
+			return mesh;
+		}
+
+		int threads = config.threads > 0 ? config.threads : (int)std::thread::hardware_concurrency();
+		// Not worth a thread for less than a few rows each
+		threads = std::max(1, std::min(threads, density / 8));
+
+		std::vector<std::vector<MeshSample>> parts(threads);
+		std::vector<std::thread> workers;
+		for (int t = 1; t < threads; t++) {
+			workers.emplace_back(generateRows, std::cref(lens), density,
+				density * t / threads, density * (t + 1) / threads, std::ref(parts[t]));
+		}
+		generateRows(lens, density, 0, density / threads, parts[0]);
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+
+		mesh.reserve((size_t)density * density);
+		for (const std::vector<MeshSample>& part : parts) {
+			mesh.insert(mesh.end(), part.begin(), part.end());
+		}
+		return mesh;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+namespace OSVRCardboard {
+	struct DistortionMeshConfig {
+		// Samples along each side of an eye's rendered image, 0 to leave
+		// distortion to RenderManager's polynomial (the fitted inverse)
+		int density = 32;
+		// Threads generating the mesh, 0 for one per core
+		int threads = 0;
+	};
+
+	/// One RenderManager "mono_point_samples" entry, both points normalized to
+	/// the eye's viewport: where on the screen, and where in the rendered eye
+	/// image the pixel there should be sampled from
+	struct MeshSample {
+		float screen[2];
+		float texture[2];
+	};
+
+	/// One eye's half of the phone screen and the lens over it
+	struct EyeLens {
+		// Viewport size on the screen, meters
+		double width;
+		double height;
+		// Lens centre, normalized viewport coordinates
+		double centerX;
+		double centerY;
+		// Lens to screen, meters, what the distortion coefficients are
+		// defined against
+		double screenDistance;
+		// Distance the exported field of view was derived at, which fixes
+		// the angles the rendered image covers
+		double projectionDistance;
+		// Cardboard's radial model, r' = r * (1 + k1 r^2 + k2 r^4 + ...) in
+		// tan-angle units
+		std::vector<float> coefficients;
+	};
+
+	/// Maps a density x density grid over the rendered image through the
+	/// lens onto the screen. Samples that land well off the viewport are left
+	/// out. Rows are evaluated in parallel and the result doesn't depend on
+	/// the thread count.
+	std::vector<MeshSample> generateDistortionMesh(const EyeLens& lens, const DistortionMeshConfig& config);
+}
@@ -0,0 +1,260 @@
+#include "EventLoop.h"
+
+#include <cstdint>
+
+#ifndef _WIN32
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace OSVRCardboard {
+
+#ifdef _WIN32
+
+	EventLoop::EventLoop()
+	{
+		if (!net::startup()) {
+			return;
+		}
+
+		m_wake_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (m_wake_socket == INVALID_SOCKET) {
+			return;
+		}
+
+		SOCKADDR_IN address = {};
+		int length = sizeof(address);
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = 0;
+
+		if (bind(m_wake_socket, (SOCKADDR*)&address, sizeof(address)) == SOCKET_ERROR ||
+			getsockname(m_wake_socket, (SOCKADDR*)&address, &length) == SOCKET_ERROR ||
+			connect(m_wake_socket, (SOCKADDR*)&address, sizeof(address)) == SOCKET_ERROR ||
+			!net::setNonBlocking(m_wake_socket))
+		{
+			return;
+		}
+
+		WSAPOLLFD wake = {};
+		wake.fd = m_wake_socket;
+		wake.events = POLLRDNORM;
+		m_poll_fds.push_back(wake);
+		m_contexts.push_back(nullptr);
+
+		m_valid = true;
+	}
+
+	EventLoop::~EventLoop()
+	{
+		if (m_wake_socket != INVALID_SOCKET) {
+			closesocket(m_wake_socket);
+		}
+		net::cleanup();
+	}
+
+	static SHORT pollEvents(unsigned events)
+	{
+		SHORT pollEvents = 0;
+		if (events & EventLoop::Readable) pollEvents |= POLLRDNORM;
+		if (events & EventLoop::Writable) pollEvents |= POLLWRNORM;
+		return pollEvents;
+	}
+
+	bool EventLoop::add(SOCKET socket, unsigned events, void* context)
+	{
+		WSAPOLLFD fd = {};
+		fd.fd = socket;
+		fd.events = pollEvents(events);
+		m_poll_fds.push_back(fd);
+		m_contexts.push_back(context);
+		return true;
+	}
+
+	bool EventLoop::modify(SOCKET socket, unsigned events, void* context)
+	{
+		for (size_t i = 1; i < m_poll_fds.size(); i++) {
+			if (m_poll_fds[i].fd == socket) {
+				m_poll_fds[i].events = pollEvents(events);
+				m_contexts[i] = context;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void EventLoop::remove(SOCKET socket)
+	{
+		for (size_t i = 1; i < m_poll_fds.size(); i++) {
+			if (m_poll_fds[i].fd == socket) {
+				m_poll_fds.erase(m_poll_fds.begin() + i);
+				m_contexts.erase(m_contexts.begin() + i);
+				return;
+			}
+		}
+	}
+
+	int EventLoop::wait(Event* events, int maxEvents, int timeoutMs)
+	{
+		int ready = WSAPoll(m_poll_fds.data(), (ULONG)m_poll_fds.size(), timeoutMs);
+		if (ready == SOCKET_ERROR) {
+			return -1;
+		}
+
+		int count = 0;
+		for (size_t i = 0; i < m_poll_fds.size() && ready > 0; i++) {
+			SHORT revents = m_poll_fds[i].revents;
+			if (!revents) continue;
+			ready--;
+
+			if (i == 0) {
+				char drain[64];
+				while (recv(m_wake_socket, drain, sizeof(drain), 0) > 0);
+				continue;
+			}
+			if (count == maxEvents) continue;
+
+			unsigned mask = 0;
+			if (revents & POLLRDNORM) mask |= Readable;
+			if (revents & POLLWRNORM) mask |= Writable;
+			if (revents & (POLLHUP | POLLERR | POLLNVAL)) mask |= Closed;
+
+			events[count].socket = m_poll_fds[i].fd;
+			events[count].events = mask;
+			events[count].context = m_contexts[i];
+			count++;
+		}
+		return count;
+	}
+
+	void EventLoop::wake()
+	{
+		char byte = 1;
+		send(m_wake_socket, &byte, 1, 0);
+	}
+
+#else
+
+	// The context pointer is what comes back from epoll, so the socket travels
+	// alongside it in a small per-registration record
+	struct EpollRegistration {
+		SOCKET socket;
+		void* context;
+	};
+
+	EventLoop::EventLoop()
+	{
+		m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_epoll_fd == -1 || m_wake_fd == -1) {
+			return;
+		}
+
+		epoll_event wake = {};
+		wake.events = EPOLLIN;
+		wake.data.ptr = this;
+		m_valid = epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &wake) == 0;
+	}
+
+	EventLoop::~EventLoop()
+	{
+		for (EpollRegistration* registration : m_registrations) {
+			delete registration;
+		}
+		if (m_wake_fd != -1) ::close(m_wake_fd);
+		if (m_epoll_fd != -1) ::close(m_epoll_fd);
+	}
+
+	static uint32_t epollEvents(unsigned events)
+	{
+		uint32_t epollEvents = 0;
+		if (events & EventLoop::Readable) epollEvents |= EPOLLIN | EPOLLRDHUP;
+		if (events & EventLoop::Writable) epollEvents |= EPOLLOUT;
+		return epollEvents;
+	}
+
+	bool EventLoop::add(SOCKET socket, unsigned events, void* context)
+	{
+		epoll_event event = {};
+		event.events = epollEvents(events);
+		event.data.ptr = new EpollRegistration{ socket, context };
+		if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, socket, &event) != 0) {
+			delete (EpollRegistration*)event.data.ptr;
+			return false;
+		}
+		m_registrations.push_back((EpollRegistration*)event.data.ptr);
+		return true;
+	}
+
+	bool EventLoop::modify(SOCKET socket, unsigned events, void* context)
+	{
+		for (EpollRegistration* registration : m_registrations) {
+			if (registration->socket == socket) {
+				registration->context = context;
+				epoll_event event = {};
+				event.events = epollEvents(events);
+				event.data.ptr = registration;
+				return epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, socket, &event) == 0;
+			}
+		}
+		return false;
+	}
+
+	void EventLoop::remove(SOCKET socket)
+	{
+		epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+		for (size_t i = 0; i < m_registrations.size(); i++) {
+			if (m_registrations[i]->socket == socket) {
+				delete m_registrations[i];
+				m_registrations.erase(m_registrations.begin() + i);
+				return;
+			}
+		}
+	}
+
+	int EventLoop::wait(Event* events, int maxEvents, int timeoutMs)
+	{
+		epoll_event ready[64];
+		if (maxEvents > 64) maxEvents = 64;
+
+		int count = epoll_wait(m_epoll_fd, ready, maxEvents, timeoutMs);
+		if (count == -1) {
+			return errno == EINTR ? 0 : -1;
+		}
+
+		int written = 0;
+		for (int i = 0; i < count; i++) {
+			if (ready[i].data.ptr == this) {
+				uint64_t value;
+				while (read(m_wake_fd, &value, sizeof(value)) > 0);
+				continue;
+			}
+
+			EpollRegistration* registration = (EpollRegistration*)ready[i].data.ptr;
+			unsigned mask = 0;
+			if (ready[i].events & EPOLLIN) mask |= Readable;
+			if (ready[i].events & EPOLLOUT) mask |= Writable;
+			if (ready[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) mask |= Closed;
+
+			events[written].socket = registration->socket;
+			events[written].events = mask;
+			events[written].context = registration->context;
+			written++;
+		}
+		return written;
+	}
+
+	void EventLoop::wake()
+	{
+		uint64_t value = 1;
+		ssize_t ignored = write(m_wake_fd, &value, sizeof(value));
+		(void)ignored;
+	}
+
+#endif
+
+	bool EventLoop::valid()
+	{
+		return m_valid;
+	}
+}
\ No newline at end of file
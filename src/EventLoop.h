@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Socket.h"
+
+#include <vector>
+
+namespace OSVRCardboard {
+	struct EpollRegistration;
+
+	/// Readiness notification for a set of non-blocking sockets: epoll on Linux,
+	/// WSAPoll on Windows. Sockets are added, modified, removed and waited on by
+	/// the owning thread only; wake() may be called from any thread and makes a
+	/// blocked wait() return immediately.
+	class EventLoop {
+	public:
+		enum {
+			Readable = 1,
+			Writable = 2,
+			Closed = 4
+		};
+
+		struct Event {
+			SOCKET socket;
+			unsigned events;
+			void* context;
+		};
+
+		EventLoop();
+		~EventLoop();
+
+		bool valid();
+
+		bool add(SOCKET socket, unsigned events, void* context = nullptr);
+		bool modify(SOCKET socket, unsigned events, void* context = nullptr);
+		void remove(SOCKET socket);
+
+		/// Blocks until at least one socket is ready, wake() is called or
+		/// timeoutMs elapses (-1 waits indefinitely). Returns the number of
+		/// events written, 0 on timeout or wake-up and -1 on error.
+		int wait(Event* events, int maxEvents, int timeoutMs);
+
+		void wake();
+
+	private:
+		EventLoop(const EventLoop&) = delete;
+		EventLoop& operator=(const EventLoop&) = delete;
+
+		bool m_valid = false;
+#ifdef _WIN32
+		// Loopback UDP socket connected to itself, used as a self-pipe
+		SOCKET m_wake_socket = INVALID_SOCKET;
+		std::vector<WSAPOLLFD> m_poll_fds;
+		std::vector<void*> m_contexts;
+#else
+		int m_epoll_fd = -1;
+		int m_wake_fd = -1;
+		std::vector<EpollRegistration*> m_registrations;
+#endif
+	};
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "HeadlessStatus.h"
+
+#include <iostream>
+
+namespace OSVRCardboard {
+	HeadlessStatus::HeadlessStatus(TrackingServer& server, const TrackingConfig& config) :
+		m_server(server), m_config(config)
+	{
+		m_thread = new std::thread(&HeadlessStatus::run, this);
+		m_server.setChangeListener([this] {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_changed = true;
+			}
+			m_wake.notify_all();
+		});
+	}
+
+	HeadlessStatus::~HeadlessStatus()
+	{
+		m_server.setChangeListener(nullptr);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_end = true;
+		}
+		m_wake.notify_all();
+		m_thread->join();
+		delete m_thread;
+	}
+
+	void HeadlessStatus::run()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			m_wake.wait(lock, [this] { return m_changed || m_end; });
+			if (m_end) break;
+			m_changed = false;
+
+			// Not holding our lock while calling into the server, the listener
+			// takes it under the server's
+			lock.unlock();
+			refresh();
+			lock.lock();
+		}
+	}
+
+	void HeadlessStatus::refresh()
+	{
+		std::string status = m_server.getStatus();
+		if (status != m_status) {
+			m_status = status;
+			std::cout << "OSVR Cardboard: " << status << std::endl;
+		}
+
+		for (int sensor = 0; sensor < m_server.sensorCount(); sensor++) {
+			if (!m_server.configChanged(sensor)) {
+				continue;
+			}
+
+			std::shared_ptr<const Viewer> viewer = m_server.config(sensor);
+			std::string viewerName = viewer->vendor() + " " + viewer->model();
+			if (viewerName.length() == 1) {
+				viewerName = "No viewer - scan QR code";
+			}
+			std::cout << "OSVR Cardboard: sensor " << sensor << " is " << viewerName << " - " << viewer->name() << std::endl;
+			if (viewer->hasMagnet()) {
+				std::cout << "OSVR Cardboard: Warning: This viewer device contains magnets which may interfere with orientation tracking." << std::endl;
+			}
+
+			// Only the first phone is the head mounted display
+			if (sensor == 0 && !m_config.profiles.displayConfig.empty()) {
+				const std::string& path = m_config.profiles.displayConfig;
+				double inverseError;
+				if (viewer->writeDisplayConfig(path, m_config.distortionMesh, m_config.inverseDistortion, &inverseError)) {
+					std::cout << "OSVR Cardboard: Display config written to " << path << std::endl;
+					if (inverseError >= 0) {
+						std::cout << "OSVR Cardboard: Inverse distortion fit to order " << m_config.inverseDistortion.order
+							<< ", max error " << inverseError << " degrees" << std::endl;
+					}
+				}
+				else {
+					std::cout << "OSVR Cardboard: Can't write display config to " << path << std::endl;
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
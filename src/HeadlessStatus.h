@@ -0,0 +1,39 @@
+#pragma once
+
+#include "TrackingServer.h"
+#include "TrackingConfig.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+namespace OSVRCardboard {
+	/// Stands in for the settings window on machines without a desktop.
+	/// Status changes are logged, and the display config for each viewer the
+	/// head tracking phone reports is written to tracking.profiles.displayConfig,
+	/// where osvr_server_config.json can point at it. Sleeps until the server
+	/// reports a change.
+	class HeadlessStatus {
+	public:
+		HeadlessStatus(TrackingServer& server, const TrackingConfig& config);
+		~HeadlessStatus();
+
+	private:
+		HeadlessStatus(const HeadlessStatus&) = delete;
+		HeadlessStatus& operator=(const HeadlessStatus&) = delete;
+
+		void run();
+		void refresh();
+
+		TrackingServer& m_server;
+		TrackingConfig m_config;
+		std::string m_status;
+
+		std::thread* m_thread = nullptr;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_changed = true;
+		bool m_end = false;
+	};
+}
\ No newline at end of file
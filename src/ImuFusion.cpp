@@ -0,0 +1,218 @@
+#include "ImuFusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace OSVRCardboard {
+	void ImuFusion::configure(int lanes, const FusionConfig& config)
+	{
+		m_config = config;
+		m_lanes = std::min(std::max(lanes, 0), TS_FUSION_MAX_LANES);
+		m_pending_count = 0;
+		for (std::vector<Pending>& pending : m_pending) {
+			pending.clear();
+		}
+		for (int lane = 0; lane < m_lanes; lane++) {
+			reset(lane);
+		}
+	}
+
+	void ImuFusion::reset(int lane)
+	{
+		m_pending_count -= m_pending[lane].size();
+		m_pending[lane].clear();
+		m_q0[lane] = 1;
+		m_q1[lane] = m_q2[lane] = m_q3[lane] = 0;
+		m_ix[lane] = m_iy[lane] = m_iz[lane] = 0;
+		m_last_time[lane] = INT64_MIN;
+		m_initialized[lane] = false;
+		m_magnetometer[lane] = m_config.magnetometer;
+	}
+
+	void ImuFusion::setMagnetometer(int lane, bool enabled)
+	{
+		m_magnetometer[lane] = enabled && m_config.magnetometer;
+	}
+
+	void ImuFusion::add(int lane, const ImuSample& sample, int64_t receiveTime)
+	{
+		m_pending[lane].push_back(Pending{ sample, receiveTime });
+		m_pending_count++;
+	}
+
+	void ImuFusion::bias(int lane, float bias[3]) const
+	{
+		bias[0] = -m_ix[lane];
+		bias[1] = -m_iy[lane];
+		bias[2] = -m_iz[lane];
+	}
+
+	// Tilt from gravity alone: the shortest rotation taking the measured up
+	// onto the world's
+	void ImuFusion::initialize(int lane, const ImuSample& sample)
+	{
+		float ax = sample.accel[0], ay = sample.accel[1], az = sample.accel[2];
+		float norm = sqrtf(ax * ax + ay * ay + az * az);
+		if (norm == 0) {
+			return;
+		}
+		ax /= norm;
+		ay /= norm;
+		az /= norm;
+
+		// q = (1 + a.up, a x up), normalized, with up = (0, 1, 0)
+		float w = 1 + ay;
+		float x = -az;
+		float y = 0;
+		float z = ax;
+		if (w < 1e-6f) {
+			// Upside down, any half turn about a horizontal axis will do
+			w = 0;
+			x = 1;
+			z = 0;
+		}
+		norm = sqrtf(w * w + x * x + y * y + z * z);
+		m_q0[lane] = w / norm;
+		m_q1[lane] = x / norm;
+		m_q2[lane] = y / norm;
+		m_q3[lane] = z / norm;
+		m_initialized[lane] = true;
+	}
+
+	void ImuFusion::process(std::vector<FusedSample>& out)
+	{
+		const int lanes = m_lanes;
+		size_t steps = 0;
+		for (int lane = 0; lane < lanes; lane++) {
+			steps = std::max(steps, m_pending[lane].size());
+		}
+
+		const float kp = m_config.kp;
+		const float ki = m_config.ki;
+
+		for (size_t step = 0; step < steps; step++) {
+			// Gather this step's inputs; lanes with nothing queued get zeroes
+			for (int lane = 0; lane < lanes; lane++) {
+				m_gx[lane] = m_gy[lane] = m_gz[lane] = 0;
+				m_ax[lane] = m_ay[lane] = m_az[lane] = 0;
+				m_mx[lane] = m_my[lane] = m_mz[lane] = 0;
+				m_dt[lane] = 0;
+				if (step >= m_pending[lane].size()) {
+					continue;
+				}
+
+				const ImuSample& sample = m_pending[lane][step].sample;
+				if (!m_initialized[lane]) {
+					initialize(lane, sample);
+				}
+
+				int64_t last = m_last_time[lane];
+				if (last != INT64_MIN && sample.timestamp > last) {
+					m_dt[lane] = std::min((sample.timestamp - last) * 1e-6f, TS_FUSION_MAX_DT);
+				}
+				if (last == INT64_MIN || sample.timestamp > last) {
+					m_last_time[lane] = sample.timestamp;
+				}
+
+				m_gx[lane] = sample.gyro[0];
+				m_gy[lane] = sample.gyro[1];
+				m_gz[lane] = sample.gyro[2];
+				m_ax[lane] = sample.accel[0];
+				m_ay[lane] = sample.accel[1];
+				m_az[lane] = sample.accel[2];
+				if (sample.hasMagnet && m_magnetometer[lane]) {
+					m_mx[lane] = sample.magnet[0];
+					m_my[lane] = sample.magnet[1];
+					m_mz[lane] = sample.magnet[2];
+				}
+			}
+
+			// The filter step itself, branch free so it vectorizes across lanes.
+			// A zero accelerometer or magnetometer reading contributes no
+			// correction, and a zero dt leaves the lane where it was.
+			for (int lane = 0; lane < lanes; lane++) {
+				float q0 = m_q0[lane], q1 = m_q1[lane], q2 = m_q2[lane], q3 = m_q3[lane];
+				float dt = m_dt[lane];
+
+				float ax = m_ax[lane], ay = m_ay[lane], az = m_az[lane];
+				float aNorm = ax * ax + ay * ay + az * az;
+				// FLT_MIN keeps a zero reading zero rather than NaN
+				float aScale = 1 / sqrtf(aNorm + FLT_MIN);
+				ax *= aScale;
+				ay *= aScale;
+				az *= aScale;
+
+				float mx = m_mx[lane], my = m_my[lane], mz = m_mz[lane];
+				float mNorm = mx * mx + my * my + mz * mz;
+				float mScale = 1 / sqrtf(mNorm + FLT_MIN);
+				mx *= mScale;
+				my *= mScale;
+				mz *= mScale;
+
+				// Body to world rotation matrix
+				float r00 = 1 - 2 * (q2 * q2 + q3 * q3), r01 = 2 * (q1 * q2 - q0 * q3), r02 = 2 * (q1 * q3 + q0 * q2);
+				float r10 = 2 * (q1 * q2 + q0 * q3), r11 = 1 - 2 * (q1 * q1 + q3 * q3), r12 = 2 * (q2 * q3 - q0 * q1);
+				float r20 = 2 * (q1 * q3 - q0 * q2), r21 = 2 * (q2 * q3 + q0 * q1), r22 = 1 - 2 * (q1 * q1 + q2 * q2);
+
+				// Where up should be in the body frame, against where it was measured
+				float ex = ay * r12 - az * r11;
+				float ey = az * r10 - ax * r12;
+				float ez = ax * r11 - ay * r10;
+
+				// The field in the world frame, flattened onto north (x) and up,
+				// then brought back to the body frame and compared the same way
+				float hx = r00 * mx + r01 * my + r02 * mz;
+				float hy = r10 * mx + r11 * my + r12 * mz;
+				float hz = r20 * mx + r21 * my + r22 * mz;
+				float north = sqrtf(hx * hx + hz * hz);
+				float wx = north * r00 + hy * r10;
+				float wy = north * r01 + hy * r11;
+				float wz = north * r02 + hy * r12;
+				ex += my * wz - mz * wy;
+				ey += mz * wx - mx * wz;
+				ez += mx * wy - my * wx;
+
+				m_ix[lane] += ki * ex * dt;
+				m_iy[lane] += ki * ey * dt;
+				m_iz[lane] += ki * ez * dt;
+
+				float gx = (m_gx[lane] + m_ix[lane] + kp * ex) * (0.5f * dt);
+				float gy = (m_gy[lane] + m_iy[lane] + kp * ey) * (0.5f * dt);
+				float gz = (m_gz[lane] + m_iz[lane] + kp * ez) * (0.5f * dt);
+
+				// q += q * (0, g) * dt / 2
+				float n0 = q0 - q1 * gx - q2 * gy - q3 * gz;
+				float n1 = q1 + q0 * gx + q2 * gz - q3 * gy;
+				float n2 = q2 + q0 * gy - q1 * gz + q3 * gx;
+				float n3 = q3 + q0 * gz + q1 * gy - q2 * gx;
+				float scale = 1 / sqrtf(n0 * n0 + n1 * n1 + n2 * n2 + n3 * n3);
+				m_q0[lane] = n0 * scale;
+				m_q1[lane] = n1 * scale;
+				m_q2[lane] = n2 * scale;
+				m_q3[lane] = n3 * scale;
+			}
+
+			for (int lane = 0; lane < lanes; lane++) {
+				if (step >= m_pending[lane].size()) {
+					continue;
+				}
+				const Pending& pending = m_pending[lane][step];
+				FusedSample fused;
+				fused.lane = lane;
+				fused.receiveTime = pending.receiveTime;
+				osvrQuatSetW(&fused.sample.quaternion, m_q0[lane]);
+				osvrQuatSetX(&fused.sample.quaternion, m_q1[lane]);
+				osvrQuatSetY(&fused.sample.quaternion, m_q2[lane]);
+				osvrQuatSetZ(&fused.sample.quaternion, m_q3[lane]);
+				fused.sample.timestamp = fromMicroseconds(pending.sample.timestamp);
+				out.push_back(fused);
+			}
+		}
+
+		for (std::vector<Pending>& pending : m_pending) {
+			pending.clear();
+		}
+		m_pending_count = 0;
+	}
+}
\ No newline at end of file
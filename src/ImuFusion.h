@@ -0,0 +1,89 @@
+#pragma once
+
+#include "TrackingTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+// Longest gap integrated across, seconds. Anything longer (a stall, lost
+// datagrams) is treated as this long rather than trusting one gyro reading
+// for all of it.
+#define TS_FUSION_MAX_DT 0.1f
+// Lanes are fixed size arrays, which the compiler can vectorize over without
+// worrying they overlap. Matches TS_MAX_SENSORS.
+#define TS_FUSION_MAX_LANES 16
+
+namespace OSVRCardboard {
+	struct FusionConfig {
+		// Proportional gain, how hard gravity (and north) pull the estimate
+		float kp = 0.5f;
+		// Integral gain, how fast gyro bias is learned, 0 to not estimate it
+		float ki = 0.02f;
+		// Use magnetometer readings for heading when a phone sends them. Off
+		// per sensor regardless while its viewer has a magnet in it.
+		bool magnetometer = true;
+	};
+
+	/// A fused orientation, for the lane (sensor) it came from
+	struct FusedSample {
+		int lane;
+		// Server clock, when the raw sample arrived
+		int64_t receiveTime;
+		TimestampedQuaternion sample;
+	};
+
+	/// Mahony's complementary filter with integral gyro bias estimation, one
+	/// lane per sensor. Queued samples for every lane are stepped together,
+	/// with the state kept as structure of arrays so each step vectorizes
+	/// across lanes; a lane with nothing at a given step just takes a zero
+	/// length step.
+	///
+	/// Frames are OSVR's: y up, and the body frame is the head's. Heading
+	/// with no magnetometer is relative to where the phone first pointed.
+	class ImuFusion {
+	public:
+		/// Up to TS_FUSION_MAX_LANES lanes
+		void configure(int lanes, const FusionConfig& config);
+
+		/// Forget the orientation and bias, for a new connection
+		void reset(int lane);
+		void setMagnetometer(int lane, bool enabled);
+
+		void add(int lane, const ImuSample& sample, int64_t receiveTime);
+		bool pending() const { return m_pending_count > 0; }
+
+		/// Runs everything queued through the filter. Output is in order for
+		/// each lane.
+		void process(std::vector<FusedSample>& out);
+
+		/// Current gyro bias estimate, radians per second
+		void bias(int lane, float bias[3]) const;
+
+	private:
+		struct Pending {
+			ImuSample sample;
+			int64_t receiveTime;
+		};
+
+		void initialize(int lane, const ImuSample& sample);
+
+		FusionConfig m_config;
+		int m_lanes = 0;
+		std::vector<Pending> m_pending[TS_FUSION_MAX_LANES];
+		size_t m_pending_count = 0;
+
+		// Per lane state
+		float m_q0[TS_FUSION_MAX_LANES], m_q1[TS_FUSION_MAX_LANES], m_q2[TS_FUSION_MAX_LANES], m_q3[TS_FUSION_MAX_LANES];
+		// Integral feedback, the negated bias estimate
+		float m_ix[TS_FUSION_MAX_LANES], m_iy[TS_FUSION_MAX_LANES], m_iz[TS_FUSION_MAX_LANES];
+		int64_t m_last_time[TS_FUSION_MAX_LANES];
+		bool m_initialized[TS_FUSION_MAX_LANES];
+		bool m_magnetometer[TS_FUSION_MAX_LANES];
+
+		// Per step inputs
+		float m_gx[TS_FUSION_MAX_LANES], m_gy[TS_FUSION_MAX_LANES], m_gz[TS_FUSION_MAX_LANES];
+		float m_ax[TS_FUSION_MAX_LANES], m_ay[TS_FUSION_MAX_LANES], m_az[TS_FUSION_MAX_LANES];
+		float m_mx[TS_FUSION_MAX_LANES], m_my[TS_FUSION_MAX_LANES], m_mz[TS_FUSION_MAX_LANES];
+		float m_dt[TS_FUSION_MAX_LANES];
+	};
+}
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "InverseDistortion.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Newton steps taken for every sample, the forward polynomial is gentle
+// enough that this converges to float precision well inside the field of view
+#define ID_NEWTON_STEPS 8
+
+namespace OSVRCardboard {
+	namespace {
+		// Solves the normal equations in place by Gaussian elimination with
+		// partial pivoting. Returns false if they're singular.
+		bool solve(std::vector<double>& matrix, std::vector<double>& rhs, int n)
+		{
+			for (int column = 0; column < n; column++) {
+				int pivot = column;
+				for (int row = column + 1; row < n; row++) {
+					if (std::abs(matrix[row * n + column]) > std::abs(matrix[pivot * n + column])) {
+						pivot = row;
+					}
+				}
+				if (std::abs(matrix[pivot * n + column]) < 1e-300) {
+					return false;
+				}
+				if (pivot != column) {
+					for (int k = 0; k < n; k++) {
+						std::swap(matrix[pivot * n + k], matrix[column * n + k]);
+					}
+					std::swap(rhs[pivot], rhs[column]);
+				}
+				for (int row = column + 1; row < n; row++) {
+					double factor = matrix[row * n + column] / matrix[column * n + column];
+					for (int k = column; k < n; k++) {
+						matrix[row * n + k] -= factor * matrix[column * n + k];
+					}
+					rhs[row] -= factor * rhs[column];
+				}
+			}
+			for (int row = n - 1; row >= 0; row--) {
+				double value = rhs[row];
+				for (int k = row + 1; k < n; k++) {
+					value -= matrix[row * n + k] * rhs[k];
+				}
+				rhs[row] = value / matrix[row * n + row];
+			}
+			return true;
+		}
+	}
+
+	double evaluateDistortion(const std::vector<double>& coefficients, double radius)
+	{
+		double r2 = radius * radius;
+		double scale = 0;
+		for (auto k = coefficients.rbegin(); k != coefficients.rend(); ++k) {
+			scale = (scale + *k) * r2;
+		}
+		return radius * (1 + scale);
+	}
+
+	InverseDistortion fitInverseDistortion(const std::vector<float>& forward, double maxRadius, const InverseDistortionConfig& config)
+	{
+		InverseDistortion result;
+		result.maxRadius = maxRadius;
+		result.maxError = 0;
+
+		const int order = config.order;
+		const int count = config.samples;
+		if (order < 1 || count < order + 1 || maxRadius <= 0) {
+			return result;
+		}
+
+		// Screen radii to fit over, and the image radius each one came from.
+		// Every sample takes the same Newton steps on flat arrays, so the
+		// loops vectorize.
+		std::vector<double> screen(count), image(count), r2(count), value(count), slope(count);
+		for (int i = 0; i < count; i++) {
+			screen[i] = maxRadius * (i + 1) / count;
+			image[i] = screen[i];
+		}
+		const int terms = (int)forward.size();
+		for (int step = 0; step < ID_NEWTON_STEPS; step++) {
+			for (int i = 0; i < count; i++) {
+				r2[i] = image[i] * image[i];
+				value[i] = 0;
+				slope[i] = 0;
+			}
+			// f(r) = r + sum k_j r^(2j+3), f'(r) = 1 + sum (2j+3) k_j r^(2j+2)
+			for (int j = terms - 1; j >= 0; j--) {
+				const double k = forward[j];
+				const double power = 2 * j + 3;
+				for (int i = 0; i < count; i++) {
+					value[i] = (value[i] + k) * r2[i];
+					slope[i] = slope[i] * r2[i] + power * k * r2[i];
+				}
+			}
+			for (int i = 0; i < count; i++) {
+				double f = image[i] * (1 + value[i]) - screen[i];
+				image[i] -= f / (1 + slope[i]);
+			}
+		}
+
+		// A mapping that folds back on itself has no inverse to fit
+		double previous = 0;
+		for (int i = 0; i < count; i++) {
+			if (!std::isfinite(image[i]) || image[i] <= previous) {
+				return result;
+			}
+			previous = image[i];
+		}
+
+		// Least squares for r / r' - 1 = sum d_j u^2j, u = r' / maxRadius, which
+		// keeps the normal equations well conditioned whatever the units
+		std::vector<double> matrix((size_t)order * order, 0.0);
+		std::vector<double> rhs(order, 0.0);
+		std::vector<double> basis(order);
+		for (int i = 0; i < count; i++) {
+			double u = screen[i] / maxRadius;
+			double u2 = u * u;
+			double target = image[i] / screen[i] - 1;
+			double power = u2;
+			for (int j = 0; j < order; j++) {
+				basis[j] = power;
+				power *= u2;
+			}
+			for (int j = 0; j < order; j++) {
+				rhs[j] += basis[j] * target;
+				for (int k = 0; k < order; k++) {
+					matrix[j * order + k] += basis[j] * basis[k];
+				}
+			}
+		}
+		if (!solve(matrix, rhs, order)) {
+			return result;
+		}
+
+		double scale = 1;
+		for (int j = 0; j < order; j++) {
+			scale *= maxRadius * maxRadius;
+			result.coefficients.push_back(rhs[j] / scale);
+		}
+
+		for (int i = 0; i < count; i++) {
+			double error = std::abs(evaluateDistortion(result.coefficients, screen[i]) - image[i]);
+			result.maxError = std::max(result.maxError, error);
+		}
+		return result;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+namespace OSVRCardboard {
+	// Only used when there's no distortion mesh, see DistortionMeshConfig
+	struct InverseDistortionConfig {
+		// Terms beyond the linear one, r = r'(1 + c1 r'^2 + ... + cn r'^2n)
+		int order = 4;
+		// Radii the fit is made over
+		int samples = 256;
+	};
+
+	/// Cardboard's coefficients take a point in the rendered image to where
+	/// it lands on the screen, r' = r(1 + k1 r^2 + k2 r^4 ...), in tan-angle
+	/// units. A pre-distortion pass wants the other direction, so this fits
+	/// a polynomial of the same form to the inverse in the least squares
+	/// sense, over the screen radii the viewport actually covers.
+	struct InverseDistortion {
+		// c1..cn, empty if the forward mapping couldn't be inverted
+		std::vector<double> coefficients;
+		// Screen radius the fit covers, tan-angle
+		double maxRadius;
+		// Largest |r - fit(r')| over the samples, tan-angle
+		double maxError;
+	};
+
+	InverseDistortion fitInverseDistortion(const std::vector<float>& forward, double maxRadius, const InverseDistortionConfig& config);
+
+	/// r'(1 + c1 r'^2 + ...) for a fitted (or forward) coefficient set
+	double evaluateDistortion(const std::vector<double>& coefficients, double radius);
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace OSVRCardboard {
+	/// Read-only memory mapping of a whole file
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		bool open(const std::string& path);
+		void close();
+
+		bool isOpen() const { return m_data != nullptr; }
+		const char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+	private:
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "Metrics.h"
+
+namespace OSVRCardboard {
+
+	uint64_t Histogram::bucketLow(size_t bucket)
+	{
+		if (bucket < TS_HISTOGRAM_LINEAR) {
+			return bucket;
+		}
+		size_t exponent = (bucket - TS_HISTOGRAM_LINEAR) / TS_HISTOGRAM_SUB_BUCKETS + 4;
+		uint64_t sub = (bucket - TS_HISTOGRAM_LINEAR) % TS_HISTOGRAM_SUB_BUCKETS;
+		return (TS_HISTOGRAM_SUB_BUCKETS + sub) << (exponent - TS_HISTOGRAM_SUB_BITS);
+	}
+
+	uint64_t Histogram::bucketHigh(size_t bucket)
+	{
+		if (bucket + 1 == TS_HISTOGRAM_BUCKETS) {
+			return UINT64_MAX;
+		}
+		return bucketLow(bucket + 1) - 1;
+	}
+
+	namespace {
+		// Fills in the summary from the bucket counts
+		void summarize(HistogramSnapshot& snapshot)
+		{
+			double sum = 0;
+			size_t highest = 0;
+
+			snapshot.count = 0;
+			for (size_t i = 0; i < TS_HISTOGRAM_BUCKETS; i++) {
+				uint64_t count = snapshot.buckets[i];
+				if (count) {
+					snapshot.count += count;
+					sum += count * ((Histogram::bucketLow(i) + (double)Histogram::bucketHigh(i)) / 2);
+					highest = i;
+				}
+			}
+			snapshot.mean = snapshot.p50 = snapshot.p90 = snapshot.p99 = snapshot.max = 0;
+			if (!snapshot.count) {
+				return;
+			}
+
+			snapshot.mean = sum / snapshot.count;
+			snapshot.max = (double)Histogram::bucketHigh(highest);
+
+			double* targets[] = { &snapshot.p50, &snapshot.p90, &snapshot.p99 };
+			double fractions[] = { 0.5, 0.9, 0.99 };
+			uint64_t seen = 0;
+			size_t next = 0;
+			for (size_t i = 0; i <= highest && next < 3; i++) {
+				seen += snapshot.buckets[i];
+				while (next < 3 && seen >= fractions[next] * snapshot.count) {
+					*targets[next++] = (Histogram::bucketLow(i) + (double)Histogram::bucketHigh(i)) / 2;
+				}
+			}
+		}
+	}
+
+	HistogramSnapshot HistogramSnapshot::since(const HistogramSnapshot& earlier) const
+	{
+		HistogramSnapshot interval = HistogramSnapshot();
+		for (size_t i = 0; i < TS_HISTOGRAM_BUCKETS; i++) {
+			interval.buckets[i] = buckets[i] - earlier.buckets[i];
+		}
+		summarize(interval);
+		return interval;
+	}
+
+	HistogramSnapshot Histogram::snapshot() const
+	{
+		HistogramSnapshot snapshot = HistogramSnapshot();
+		for (size_t i = 0; i < TS_HISTOGRAM_BUCKETS; i++) {
+			snapshot.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+		}
+		summarize(snapshot);
+		return snapshot;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Log-linear histogram layout: values below TS_HISTOGRAM_LINEAR get a bucket
+// each, above that every power of two is split into TS_HISTOGRAM_SUB_BUCKETS,
+// so a bucket is never more than 12.5% wide
+#define TS_HISTOGRAM_LINEAR 16
+#define TS_HISTOGRAM_SUB_BITS 3
+#define TS_HISTOGRAM_SUB_BUCKETS (1 << TS_HISTOGRAM_SUB_BITS)
+#define TS_HISTOGRAM_BUCKETS (TS_HISTOGRAM_LINEAR + (64 - 4) * TS_HISTOGRAM_SUB_BUCKETS)
+
+namespace OSVRCardboard {
+	struct MetricsConfig {
+		// Seconds between reports
+		double interval = 10;
+		// Appended to as one JSON object per sensor per report
+		std::string file;
+		// host:port of a statsd compatible collector, reached over UDP. The
+		// host can be a name or an IPv4 address; the port defaults to 8125.
+		std::string statsd;
+		std::string prefix = "osvr.cardboard";
+	};
+
+	/*
+		Hot path instrumentation. Every metric has exactly one writing thread
+		(the network thread, or the thread draining samples), so updates are a
+		relaxed load and store with no read-modify-write, and readers on other
+		threads see values that may be a moment stale but are never torn.
+	*/
+
+	class Counter {
+	public:
+		void add(uint64_t n = 1)
+		{
+			m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		uint64_t value() const
+		{
+			return m_value.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<uint64_t> m_value{ 0 };
+	};
+
+	class HighWater {
+	public:
+		void observe(uint64_t value)
+		{
+			if (value > m_value.load(std::memory_order_relaxed)) {
+				m_value.store(value, std::memory_order_relaxed);
+			}
+		}
+
+		uint64_t value() const
+		{
+			return m_value.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<uint64_t> m_value{ 0 };
+	};
+
+	/// Covers everything recorded since the server started. Histograms only
+	/// ever grow, so since() can summarise just what came between two.
+	struct HistogramSnapshot {
+		uint64_t count;
+		// Estimated from bucket midpoints, in the unit values were recorded in
+		double mean;
+		double p50;
+		double p90;
+		double p99;
+		double max;
+		uint64_t buckets[TS_HISTOGRAM_BUCKETS];
+
+		/// Only what was recorded after earlier was taken
+		HistogramSnapshot since(const HistogramSnapshot& earlier) const;
+	};
+
+	class Histogram {
+	public:
+		void record(uint64_t value)
+		{
+			std::atomic<uint64_t>& bucket = m_buckets[bucketOf(value)];
+			bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		HistogramSnapshot snapshot() const;
+
+		static size_t bucketOf(uint64_t value)
+		{
+			if (value < TS_HISTOGRAM_LINEAR) {
+				return (size_t)value;
+			}
+#ifdef _MSC_VER
+			unsigned long exponent;
+			_BitScanReverse64(&exponent, value);
+#else
+			unsigned exponent = 63 - __builtin_clzll(value);
+#endif
+			size_t sub = (size_t)(value >> (exponent - TS_HISTOGRAM_SUB_BITS)) & (TS_HISTOGRAM_SUB_BUCKETS - 1);
+			return TS_HISTOGRAM_LINEAR + (exponent - 4) * TS_HISTOGRAM_SUB_BUCKETS + sub;
+		}
+
+		static uint64_t bucketLow(size_t bucket);
+		static uint64_t bucketHigh(size_t bucket);
+
+	private:
+		std::atomic<uint64_t> m_buckets[TS_HISTOGRAM_BUCKETS] = {};
+	};
+
+	/// Everything measured for one sensor's stream
+	struct PipelineMetrics {
+		// Network thread
+		Counter bytesReceived;
+		Counter messagesReceived;
+		Counter samplesParsed;
+		Counter parseFailures;
+		Counter samplesQueued;
+		HighWater queueHighWater;
+		// Microseconds between receives that brought samples, and how much that
+		// varies from one to the next. Samples sharing a read, batch or
+		// datagram count once.
+		Histogram interArrival;
+		Histogram jitter;
+		int64_t lastArrival = INT64_MIN;
+		int64_t lastInterval = -1;
+
+		// Draining thread
+		Counter samplesDelivered;
+		// Microseconds from the sample's timestamp to it being drained
+		Histogram sampleAge;
+	};
+
+	struct MetricsSnapshot {
+		// Server clock, microseconds
+		int64_t time;
+		bool connected;
+		uint64_t bytesReceived;
+		uint64_t messagesReceived;
+		uint64_t samplesParsed;
+		uint64_t parseFailures;
+		uint64_t samplesQueued;
+		uint64_t samplesDropped;
+		uint64_t samplesDelivered;
+		uint64_t queueDepth;
+		uint64_t queueHighWater;
+		HistogramSnapshot interArrival;
+		HistogramSnapshot jitter;
+		HistogramSnapshot sampleAge;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "MetricsReporter.h"
+
+#include <json/json.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace OSVRCardboard {
+	namespace {
+		double perSecond(uint64_t now, uint64_t before, int64_t microseconds)
+		{
+			return microseconds > 0 ? (now - before) * 1e6 / microseconds : 0;
+		}
+
+		Json::Value toJson(const HistogramSnapshot& histogram)
+		{
+			Json::Value json;
+			json["count"] = (Json::UInt64)histogram.count;
+			json["mean"] = histogram.mean;
+			json["p50"] = histogram.p50;
+			json["p90"] = histogram.p90;
+			json["p99"] = histogram.p99;
+			json["max"] = histogram.max;
+			return json;
+		}
+	}
+
+	MetricsReporter::MetricsReporter(TrackingServer& server, const MetricsConfig& config) :
+		m_server(server), m_config(config), m_previous(server.sensorCount(), MetricsSnapshot())
+	{
+		if (!m_config.statsd.empty()) {
+			std::string host = m_config.statsd;
+			int port = 8125;
+			size_t colon = host.rfind(':');
+			if (colon != std::string::npos) {
+				port = atoi(host.c_str() + colon + 1);
+				host.resize(colon);
+			}
+
+			// Looked up once; a collector that moves needs a restart
+			addrinfo hints = addrinfo();
+			hints.ai_family = AF_INET;
+			hints.ai_socktype = SOCK_DGRAM;
+			addrinfo* found = nullptr;
+			if (net::startup() && getaddrinfo(host.c_str(), nullptr, &hints, &found) == 0 && found) {
+				m_statsd_address = *(SOCKADDR_IN*)found->ai_addr;
+				m_statsd_address.sin_port = htons((u_short)port);
+				m_statsd_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			}
+			if (found) {
+				freeaddrinfo(found);
+			}
+			if (m_statsd_socket == INVALID_SOCKET) {
+				std::cout << "Can't reach statsd at " << m_config.statsd << ", not reporting to it" << std::endl;
+			}
+		}
+
+		for (int sensor = 0; sensor < (int)m_previous.size(); sensor++) {
+			m_previous[sensor] = m_server.metrics(sensor);
+		}
+
+		bool enabled = !m_config.file.empty() || m_statsd_socket != INVALID_SOCKET;
+		if (enabled && m_config.interval > 0) {
+			m_thread = new std::thread(&MetricsReporter::run, this);
+		}
+	}
+
+	MetricsReporter::~MetricsReporter()
+	{
+		if (m_thread) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_end = true;
+			}
+			m_wake.notify_all();
+			m_thread->join();
+			delete m_thread;
+		}
+		if (m_statsd_socket != INVALID_SOCKET) {
+			closesocket(m_statsd_socket);
+			net::cleanup();
+		}
+	}
+
+	void MetricsReporter::run()
+	{
+		auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_config.interval));
+		auto next = std::chrono::steady_clock::now() + interval;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_wake.wait_until(lock, next, [this] { return m_end; })) {
+			lock.unlock();
+			report();
+			lock.lock();
+			next += interval;
+		}
+	}
+
+	void MetricsReporter::report()
+	{
+		std::lock_guard<std::mutex> lock(m_report_mutex);
+
+		for (int sensor = 0; sensor < (int)m_previous.size(); sensor++) {
+			MetricsSnapshot snapshot = m_server.metrics(sensor);
+			MetricsSnapshot& previous = m_previous[sensor];
+
+			// Sensors that have never had a phone are just noise
+			if (snapshot.connected || snapshot.bytesReceived) {
+				if (!m_config.file.empty()) {
+					writeFile(sensor, snapshot, previous);
+				}
+				if (m_statsd_socket != INVALID_SOCKET) {
+					sendStatsd(sensor, snapshot, previous);
+				}
+			}
+			previous = snapshot;
+		}
+	}
+
+	void MetricsReporter::writeFile(int sensor, const MetricsSnapshot& snapshot, const MetricsSnapshot& previous)
+	{
+		int64_t elapsed = snapshot.time - previous.time;
+		Json::Value json;
+		Json::FastWriter writer;
+
+		json["time"] = (Json::Int64)snapshot.time;
+		json["sensor"] = sensor;
+		json["connected"] = snapshot.connected;
+		json["bytesReceived"] = (Json::UInt64)snapshot.bytesReceived;
+		json["bytesPerSecond"] = perSecond(snapshot.bytesReceived, previous.bytesReceived, elapsed);
+		json["messagesReceived"] = (Json::UInt64)snapshot.messagesReceived;
+		json["samplesParsed"] = (Json::UInt64)snapshot.samplesParsed;
+		json["samplesPerSecond"] = perSecond(snapshot.samplesParsed, previous.samplesParsed, elapsed);
+		json["parseFailures"] = (Json::UInt64)snapshot.parseFailures;
+		json["samplesQueued"] = (Json::UInt64)snapshot.samplesQueued;
+		json["samplesDropped"] = (Json::UInt64)snapshot.samplesDropped;
+		json["samplesDelivered"] = (Json::UInt64)snapshot.samplesDelivered;
+		json["queueDepth"] = (Json::UInt64)snapshot.queueDepth;
+		json["queueHighWater"] = (Json::UInt64)snapshot.queueHighWater;
+		// Microseconds, over just this report's interval
+		json["interArrival"] = toJson(snapshot.interArrival.since(previous.interArrival));
+		json["jitter"] = toJson(snapshot.jitter.since(previous.jitter));
+		json["sampleAge"] = toJson(snapshot.sampleAge.since(previous.sampleAge));
+
+		// FastWriter terminates with a newline, so the file is one object per line
+		std::ofstream file(m_config.file, std::ios::app);
+		file << writer.write(json);
+	}
+
+	void MetricsReporter::sendStatsd(int sensor, const MetricsSnapshot& snapshot, const MetricsSnapshot& previous)
+	{
+		char packet[1400];
+		int length = 0;
+		std::string prefix = m_config.prefix + ".sensor" + std::to_string(sensor) + ".";
+
+		auto append = [&](const char* name, double value, const char* type) {
+			int written = snprintf(packet + length, sizeof(packet) - length, "%s%s:%.6g|%s\n", prefix.c_str(), name, value, type);
+			if (written > 0 && length + written < (int)sizeof(packet)) {
+				length += written;
+			}
+		};
+		// Gauges of the latest interval alone, so a spike shows when it happens
+		// rather than fading into the lifetime's percentiles
+		auto histogram = [&](const char* name, const HistogramSnapshot& now, const HistogramSnapshot& before) {
+			HistogramSnapshot values = now.since(before);
+			std::string metric(name);
+			append((metric + "_p50_us").c_str(), values.p50, "g");
+			append((metric + "_p99_us").c_str(), values.p99, "g");
+			append((metric + "_max_us").c_str(), values.max, "g");
+		};
+
+		// Counters go out as deltas since the last report
+		append("bytes_received", (double)(snapshot.bytesReceived - previous.bytesReceived), "c");
+		append("messages_received", (double)(snapshot.messagesReceived - previous.messagesReceived), "c");
+		append("samples_parsed", (double)(snapshot.samplesParsed - previous.samplesParsed), "c");
+		append("parse_failures", (double)(snapshot.parseFailures - previous.parseFailures), "c");
+		append("samples_dropped", (double)(snapshot.samplesDropped - previous.samplesDropped), "c");
+		append("samples_delivered", (double)(snapshot.samplesDelivered - previous.samplesDelivered), "c");
+		append("connected", snapshot.connected ? 1 : 0, "g");
+		append("queue_depth", (double)snapshot.queueDepth, "g");
+		append("queue_high_water", (double)snapshot.queueHighWater, "g");
+		histogram("inter_arrival", snapshot.interArrival, previous.interArrival);
+		histogram("jitter", snapshot.jitter, previous.jitter);
+		histogram("sample_age", snapshot.sampleAge, previous.sampleAge);
+
+		sendto(m_statsd_socket, packet, length, 0, (SOCKADDR*)&m_statsd_address, sizeof(m_statsd_address));
+	}
+}
\ No newline at end of file
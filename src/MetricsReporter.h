@@ -0,0 +1,46 @@
+#pragma once
+
+#include "TrackingServer.h"
+#include "Metrics.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+namespace OSVRCardboard {
+	/// Periodically snapshots the TrackingServer's metrics and writes them to a
+	/// file and/or a statsd endpoint, on its own thread so that neither the
+	/// network thread nor the update callback ever waits on I/O. Does nothing
+	/// if no destination is configured.
+	class MetricsReporter {
+	public:
+		MetricsReporter(TrackingServer& server, const MetricsConfig& config);
+		~MetricsReporter();
+
+		/// Report straight away, from the calling thread
+		void report();
+
+	private:
+		MetricsReporter(const MetricsReporter&) = delete;
+		MetricsReporter& operator=(const MetricsReporter&) = delete;
+
+		void run();
+		void writeFile(int sensor, const MetricsSnapshot& snapshot, const MetricsSnapshot& previous);
+		void sendStatsd(int sensor, const MetricsSnapshot& snapshot, const MetricsSnapshot& previous);
+
+		TrackingServer& m_server;
+		MetricsConfig m_config;
+		// Guards m_previous and the destinations, report() can race the thread
+		std::mutex m_report_mutex;
+		std::vector<MetricsSnapshot> m_previous;
+		SOCKET m_statsd_socket = INVALID_SOCKET;
+		SOCKADDR_IN m_statsd_address;
+
+		std::thread* m_thread = nullptr;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_end = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "OrientationFilter.h"
+
+#include <algorithm>
+
+namespace OSVRCardboard {
+
+	namespace {
+		// One Euro smoothing factor for a cutoff (Hz) over dt (seconds)
+		inline double smoothing(double cutoff, double dt)
+		{
+			double tau = 1 / (2 * 3.14159265358979 * cutoff);
+			return 1 / (1 + tau / dt);
+		}
+
+		// Angle between two unit quaternions already in the same hemisphere.
+		// Cheaper than quatLog for the small steps between samples.
+		inline double angleBetween(const Quat& a, const Quat& b)
+		{
+			Quat d = quatMultiply(quatConjugate(a), b);
+			double sinHalf = sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+			return 2 * asin(std::min(sinHalf, 1.0));
+		}
+
+		// Normalized lerp, which for the small steps a smoother takes is as
+		// good as slerp without the trigonometry
+		inline Quat nlerp(const Quat& a, const Quat& b, double t)
+		{
+			return quatNormalize(Quat{
+				a.w + (b.w - a.w) * t,
+				a.x + (b.x - a.x) * t,
+				a.y + (b.y - a.y) * t,
+				a.z + (b.z - a.z) * t
+			});
+		}
+	}
+
+	OrientationFilter::OrientationFilter(const FilterConfig& config) : m_config(config) {}
+
+	void OrientationFilter::reset()
+	{
+		m_started = false;
+		m_speed = 0;
+	}
+
+	size_t OrientationFilter::process(TimestampedQuaternion* samples, size_t count)
+	{
+		// Validate and renormalize the whole batch first, compacting out
+		// anything that isn't a rotation
+		size_t kept = 0;
+		for (size_t i = 0; i < count; i++) {
+			OSVR_Quaternion& q = samples[i].quaternion;
+			double w = osvrQuatGetW(&q), x = osvrQuatGetX(&q), y = osvrQuatGetY(&q), z = osvrQuatGetZ(&q);
+			double norm = w * w + x * x + y * y + z * z;
+			// Also false for NaN
+			if (!(norm > 1e-12 && norm < 1e12)) {
+				m_rejected++;
+				continue;
+			}
+			double scale = 1 / sqrt(norm);
+			osvrQuatSetW(&q, w * scale);
+			osvrQuatSetX(&q, x * scale);
+			osvrQuatSetY(&q, y * scale);
+			osvrQuatSetZ(&q, z * scale);
+			samples[kept++] = samples[i];
+		}
+
+		for (size_t i = 0; i < kept; i++) {
+			TimestampedQuaternion& sample = samples[i];
+			Quat q = toQuat(sample.quaternion);
+			int64_t time = toMicroseconds(sample.timestamp);
+			double dt = (time - m_last_time) / 1e6;
+
+			if (!m_started || dt < 0 || dt > TS_FILTER_MAX_GAP) {
+				// Pick a hemisphere by w and stick to it from here on
+				if (q.w < 0) q = Quat{ -q.w, -q.x, -q.y, -q.z };
+				m_started = true;
+				m_raw = m_filtered = q;
+				m_speed = 0;
+			}
+			else {
+				if (quatDot(q, m_raw) < 0) q = Quat{ -q.w, -q.x, -q.y, -q.z };
+
+				if (m_config.enabled && dt > 0) {
+					double speed = angleBetween(m_raw, q) / dt;
+					m_speed += (speed - m_speed) * smoothing(m_config.derivativeCutoff, dt);
+					double cutoff = m_config.minCutoff + m_config.beta * m_speed;
+
+					// The raw stream stays continuous, so the output does too
+					m_filtered = nlerp(m_filtered, q, smoothing(cutoff, dt));
+				}
+				else if (!m_config.enabled) {
+					m_filtered = q;
+				}
+				m_raw = q;
+			}
+
+			m_last_time = time;
+			sample.quaternion = toOsvr(m_filtered);
+		}
+		return kept;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "TrackingTypes.h"
+#include "Quaternion.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Seconds. A gap longer than this (or time going backwards, as after a
+// reconnect) restarts the smoother instead of smoothing across it.
+#define TS_FILTER_MAX_GAP 0.5
+
+namespace OSVRCardboard {
+	struct FilterConfig {
+		// Smoothing; validation always runs
+		bool enabled = false;
+		// One Euro parameters. The cutoff is minCutoff at rest and rises by
+		// beta Hz per radian per second of rotation, so slow movement is
+		// smoothed hard and fast movement barely lags. Tuned with
+		// cardboard_filter_benchmark so the error against the true motion is
+		// no worse than the unfiltered input's.
+		double minCutoff = 1.0;
+		double beta = 60;
+		// Smoothing of the speed estimate that drives the cutoff
+		double derivativeCutoff = 1.0;
+	};
+
+	/// Sits between the TrackingServer and the tracker send, one per sensor.
+	/// Drops samples that aren't rotations (NaN, infinite, zero length),
+	/// renormalizes the rest, keeps each in the same hemisphere as the one
+	/// before so q and -q don't alternate, then optionally applies a One Euro
+	/// filter to the rotation.
+	class OrientationFilter {
+	public:
+		OrientationFilter(const FilterConfig& config = FilterConfig());
+
+		/// Filters samples in place, oldest first. Returns how many are left.
+		size_t process(TimestampedQuaternion* samples, size_t count);
+
+		/// Samples dropped as invalid so far
+		uint64_t rejected() const { return m_rejected; }
+
+		void reset();
+
+	private:
+		FilterConfig m_config;
+		bool m_started = false;
+		int64_t m_last_time = 0;
+		// Last sample in, after validation, and last sample out
+		Quat m_raw;
+		Quat m_filtered;
+		// Smoothed angular speed, radians per second
+		double m_speed = 0;
+		uint64_t m_rejected = 0;
+	};
+}
\ No newline at end of file
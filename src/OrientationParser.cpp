@@ -0,0 +1,133 @@
+#include "OrientationParser.h"
+
+#include <charconv>
+
+namespace OSVRCardboard {
+	namespace {
+		enum Member : unsigned {
+			X = 1,
+			Y = 2,
+			Z = 4,
+			W = 8,
+			S = 16,
+			M = 32,
+			SS = 64,
+			SM = 128,
+			RS = 256,
+			RM = 512
+		};
+
+		const unsigned OrientationMembers = X | Y | Z | W | S | M;
+		const unsigned ClockSyncMembers = S | M;
+		const unsigned ClockSyncResultMembers = S | M | SS | SM | RS | RM;
+
+		inline const char* skipSpace(const char* p, const char* end)
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+			return p;
+		}
+
+		inline unsigned member(const char* name, size_t length)
+		{
+			if (length == 2 && (name[0] == 's' || name[0] == 'r')) {
+				if (name[1] == 's') return name[0] == 's' ? SS : RS;
+				if (name[1] == 'm') return name[0] == 's' ? SM : RM;
+				return 0;
+			}
+			if (length != 1) return 0;
+			switch (*name) {
+			case 'x': return X;
+			case 'y': return Y;
+			case 'z': return Z;
+			case 'w': return W;
+			case 's': return S;
+			case 'm': return M;
+			default: return 0;
+			}
+		}
+	}
+
+	ParsedLine parseLine(std::string_view line)
+	{
+		ParsedLine result;
+		result.type = LineType::Invalid;
+
+		const char* p = line.data();
+		const char* end = p + line.size();
+		double x = 0, y = 0, z = 0, w = 0;
+		long long seconds = 0, microseconds = 0;
+		long long serverSeconds = 0, serverMicroseconds = 0;
+		long long receiveSeconds = 0, receiveMicroseconds = 0;
+		unsigned seen = 0;
+
+		p = skipSpace(p, end);
+		if (p == end || *p != '{') return result;
+		p++;
+
+		while (true) {
+			p = skipSpace(p, end);
+			if (p == end || *p != '"') return result;
+
+			const char* name = ++p;
+			while (p < end && *p != '"') p++;
+			if (p == end) return result;
+
+			unsigned current = member(name, p - name);
+			if (!current) {
+				result.type = LineType::Json;
+				return result;
+			}
+
+			p = skipSpace(p + 1, end);
+			if (p == end || *p != ':') return result;
+			p = skipSpace(p + 1, end);
+
+			std::from_chars_result parsed;
+			switch (current) {
+			case X: parsed = std::from_chars(p, end, x); break;
+			case Y: parsed = std::from_chars(p, end, y); break;
+			case Z: parsed = std::from_chars(p, end, z); break;
+			case W: parsed = std::from_chars(p, end, w); break;
+			case S: parsed = std::from_chars(p, end, seconds); break;
+			case M: parsed = std::from_chars(p, end, microseconds); break;
+			case SS: parsed = std::from_chars(p, end, serverSeconds); break;
+			case SM: parsed = std::from_chars(p, end, serverMicroseconds); break;
+			case RS: parsed = std::from_chars(p, end, receiveSeconds); break;
+			default: parsed = std::from_chars(p, end, receiveMicroseconds); break;
+			}
+			if (parsed.ec != std::errc()) return result;
+			seen |= current;
+
+			p = skipSpace(parsed.ptr, end);
+			if (p == end) return result;
+			if (*p == '}') break;
+			if (*p != ',') return result;
+			p++;
+		}
+
+		if (seen == OrientationMembers) {
+			result.type = LineType::Orientation;
+			osvrQuatSetX(&result.sample.quaternion, x);
+			osvrQuatSetY(&result.sample.quaternion, y);
+			osvrQuatSetZ(&result.sample.quaternion, z);
+			osvrQuatSetW(&result.sample.quaternion, w);
+			result.sample.timestamp.seconds = seconds;
+			result.sample.timestamp.microseconds = (OSVR_TimeValue_Microseconds)microseconds;
+		}
+		else if (seen == ClockSyncMembers) {
+			result.type = LineType::ClockSync;
+			result.clientTime.seconds = seconds;
+			result.clientTime.microseconds = (OSVR_TimeValue_Microseconds)microseconds;
+		}
+		else if (seen == ClockSyncResultMembers) {
+			result.type = LineType::ClockSyncResult;
+			result.clientTime.seconds = seconds;
+			result.clientTime.microseconds = (OSVR_TimeValue_Microseconds)microseconds;
+			result.serverTime.seconds = serverSeconds;
+			result.serverTime.microseconds = (OSVR_TimeValue_Microseconds)serverMicroseconds;
+			result.clientReceiveTime.seconds = receiveSeconds;
+			result.clientReceiveTime.microseconds = (OSVR_TimeValue_Microseconds)receiveMicroseconds;
+		}
+		return result;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "TrackingTypes.h"
+
+#include <string_view>
+
+namespace OSVRCardboard {
+	enum class LineType {
+		// {"x":..,"y":..,"z":..,"w":..,"s":..,"m":..}
+		Orientation,
+		// {"s":..,"m":..}
+		ClockSync,
+		// {"s":..,"m":..,"ss":..,"sm":..,"rs":..,"rm":..}, a clock sync reply
+		// echoed back with the time the client received it
+		ClockSyncResult,
+		// Has members the fast path doesn't know, needs a full JSON parse
+		Json,
+		// Not something we can use, and not worth a JSON parse either
+		Invalid
+	};
+
+	struct ParsedLine {
+		LineType type;
+		TimestampedQuaternion sample;
+		OSVR_TimeValue clientTime;
+		OSVR_TimeValue serverTime;
+		OSVR_TimeValue clientReceiveTime;
+	};
+
+	/// Allocation free, locale independent parser for the high rate text
+	/// messages. Members may come in any order, with optional whitespace.
+	/// Anything carrying a member name other than the ones above (config,
+	/// handshake) is classified as Json as soon as that name is seen.
+	ParsedLine parseLine(std::string_view line);
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "PosePredictor.h"
+
+namespace OSVRCardboard {
+
+	PosePredictor::PosePredictor(const PredictionConfig& config) : m_config(config) {}
+
+	void PosePredictor::addSample(const TimestampedQuaternion& sample)
+	{
+		if (m_count && toMicroseconds(sample.timestamp) <= toMicroseconds(m_history[m_newest].timestamp)) {
+			return;
+		}
+
+		m_newest = m_count ? (m_newest + 1) % TS_PREDICTION_HISTORY : 0;
+		m_history[m_newest] = sample;
+		if (m_count < TS_PREDICTION_HISTORY) m_count++;
+
+		estimate();
+	}
+
+	void PosePredictor::estimate()
+	{
+		const TimestampedQuaternion& newest = m_history[m_newest];
+		Quat inverse = quatConjugate(toQuat(newest.quaternion));
+		int64_t newestTime = toMicroseconds(newest.timestamp);
+
+		// Each older sample's rotation relative to the newest, r(t), is fitted
+		// as w t (+ a t^2 / 2) with t <= 0 relative to the newest sample
+		double t2 = 0, t3 = 0, t4 = 0;
+		Vec3 rt = Vec3{ 0, 0, 0 };
+		Vec3 rt2 = Vec3{ 0, 0, 0 };
+		size_t used = 0;
+
+		for (size_t i = 1; i < m_count; i++) {
+			const TimestampedQuaternion& sample = m_history[(m_newest + TS_PREDICTION_HISTORY - i) % TS_PREDICTION_HISTORY];
+			double t = (toMicroseconds(sample.timestamp) - newestTime) / 1e6;
+			if (-t > m_config.window) break;
+
+			Vec3 r = quatLog(quatMultiply(inverse, toQuat(sample.quaternion)));
+			t2 += t * t;
+			t3 += t * t * t;
+			t4 += t * t * t * t;
+			rt = Vec3{ rt.x + r.x * t, rt.y + r.y * t, rt.z + r.z * t };
+			rt2 = Vec3{ rt2.x + r.x * t * t, rt2.y + r.y * t * t, rt2.z + r.z * t * t };
+			used++;
+		}
+
+		if (!used || t2 < 1e-12) {
+			m_velocity = m_acceleration = Vec3{ 0, 0, 0 };
+			return;
+		}
+
+		// Normal equations for [w, a/2]: | t2 t3 | |w  |   | rt  |
+		//                                 | t3 t4 | |a/2| = | rt2 |
+		double determinant = t2 * t4 - t3 * t3;
+		if (m_config.acceleration && used >= 2 && fabs(determinant) > 1e-18) {
+			m_velocity = Vec3{
+				(rt.x * t4 - rt2.x * t3) / determinant,
+				(rt.y * t4 - rt2.y * t3) / determinant,
+				(rt.z * t4 - rt2.z * t3) / determinant
+			};
+			m_acceleration = Vec3{
+				2 * (rt2.x * t2 - rt.x * t3) / determinant,
+				2 * (rt2.y * t2 - rt.y * t3) / determinant,
+				2 * (rt2.z * t2 - rt.z * t3) / determinant
+			};
+		}
+		else {
+			m_velocity = Vec3{ rt.x / t2, rt.y / t2, rt.z / t2 };
+			m_acceleration = Vec3{ 0, 0, 0 };
+		}
+	}
+
+	bool PosePredictor::predict(const OSVR_TimeValue& target, TimestampedQuaternion& prediction) const
+	{
+		if (!m_count) {
+			return false;
+		}
+
+		const TimestampedQuaternion& newest = m_history[m_newest];
+		double horizon = (toMicroseconds(target) - toMicroseconds(newest.timestamp)) / 1e6;
+		if (horizon < 0) horizon = 0;
+		if (horizon > m_config.maxHorizon) horizon = m_config.maxHorizon;
+
+		double half = horizon * horizon / 2;
+		Vec3 rotation = Vec3{
+			m_velocity.x * horizon + m_acceleration.x * half,
+			m_velocity.y * horizon + m_acceleration.y * half,
+			m_velocity.z * horizon + m_acceleration.z * half
+		};
+
+		prediction.quaternion = toOsvr(quatNormalize(quatMultiply(toQuat(newest.quaternion), quatExp(rotation))));
+		prediction.timestamp = fromMicroseconds(toMicroseconds(newest.timestamp) + (int64_t)(horizon * 1e6));
+		return true;
+	}
+
+	Vec3 PosePredictor::angularVelocity() const
+	{
+		return m_velocity;
+	}
+
+	void PosePredictor::reset()
+	{
+		m_count = 0;
+		m_newest = 0;
+		m_velocity = m_acceleration = Vec3{ 0, 0, 0 };
+	}
+}
\ No newline at end of file
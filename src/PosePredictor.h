@@ -0,0 +1,47 @@
+#pragma once
+
+#include "TrackingTypes.h"
+#include "Quaternion.h"
+
+#define TS_PREDICTION_HISTORY 32
+
+namespace OSVRCardboard {
+	struct PredictionConfig {
+		bool enabled = false;
+		// All in seconds
+		double lookahead = 0.016;
+		double maxHorizon = 0.1;
+		double window = 0.05;
+		bool acceleration = false;
+	};
+
+	/// Extrapolates orientation forward in time. Angular velocity (and
+	/// optionally acceleration) is a least squares fit over the samples in the
+	/// history window, so uneven sample spacing is handled naturally.
+	class PosePredictor {
+	public:
+		PosePredictor(const PredictionConfig& config = PredictionConfig());
+
+		/// Samples must arrive in timestamp order, anything older is ignored
+		void addSample(const TimestampedQuaternion& sample);
+
+		/// The newest sample rotated forward to target, which is clamped to the
+		/// maximum horizon. False until there's a sample to extrapolate from.
+		bool predict(const OSVR_TimeValue& target, TimestampedQuaternion& prediction) const;
+
+		/// Body frame, radians per second
+		Vec3 angularVelocity() const;
+
+		void reset();
+
+	private:
+		void estimate();
+
+		PredictionConfig m_config;
+		TimestampedQuaternion m_history[TS_PREDICTION_HISTORY];
+		size_t m_count = 0;
+		size_t m_newest = 0;
+		Vec3 m_velocity = Vec3{ 0, 0, 0 };
+		Vec3 m_acceleration = Vec3{ 0, 0, 0 };
+	};
+}
\ No newline at end of file
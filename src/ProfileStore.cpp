@@ -0,0 +1,230 @@
+#include "ProfileStore.h"
+#include "WireProtocol.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace OSVRCardboard {
+
+	bool ProfileStore::open(const std::string& path)
+	{
+		close();
+
+		// Created now so a store that can never be written shows up at startup
+		FILE* file = fopen(path.c_str(), "ab");
+		if (!file) {
+			return false;
+		}
+		fclose(file);
+
+		m_path = path;
+		if (load() && !rewrite()) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void ProfileStore::close()
+	{
+		m_file.close();
+		m_profiles.clear();
+		m_index.clear();
+		m_devices.clear();
+		m_sensors.clear();
+		m_path.clear();
+	}
+
+	const ProfileStore::Profile* ProfileStore::find(std::string_view deviceName, uint64_t viewerHash) const
+	{
+		auto found = m_index.find(key(deviceName, viewerHash));
+		return found == m_index.end() ? nullptr : &m_profiles[found->second];
+	}
+
+	const ProfileStore::Profile* ProfileStore::lastForDevice(std::string_view deviceName) const
+	{
+		auto found = m_devices.find(std::string(deviceName));
+		return found == m_devices.end() ? nullptr : &m_profiles[found->second];
+	}
+
+	const ProfileStore::Profile* ProfileStore::lastOnSensor(int sensor) const
+	{
+		auto found = m_sensors.find(sensor);
+		return found == m_sensors.end() ? nullptr : &m_profiles[found->second];
+	}
+
+	bool ProfileStore::put(int sensor, std::string_view deviceName, std::string_view viewerParams, std::string_view config)
+	{
+		if (!isOpen() || sensor < 0 || sensor > 255 || deviceName.size() > UINT16_MAX || config.size() > UINT32_MAX) {
+			return false;
+		}
+
+		Profile profile = { deviceName, hashViewerParams(viewerParams), sensor, config, true };
+		const Profile* existing = find(deviceName, profile.viewerHash);
+		// Reconnecting the same phone in the same viewer shouldn't grow the file
+		if (existing && existing->sensor == sensor && existing->config == config &&
+			lastForDevice(deviceName) == existing && lastOnSensor(sensor) == existing)
+		{
+			return true;
+		}
+
+		std::string record;
+		if (!m_file.isOpen()) {
+			char header[OSVR_CARDBOARD_PROFILE_HEADER_SIZE];
+			wire::putU32(header, OSVR_CARDBOARD_PROFILE_MAGIC);
+			wire::putU16(header + 4, OSVR_CARDBOARD_PROFILE_VERSION);
+			wire::putU16(header + 6, 0);
+			record.append(header, sizeof(header));
+		}
+		append(record, profile);
+
+		FILE* file = fopen(m_path.c_str(), "ab");
+		if (!file) {
+			return false;
+		}
+		bool written = fwrite(record.data(), 1, record.size(), file) == record.size();
+		written = fclose(file) == 0 && written;
+
+		// Remapped to take in the new record, which also drops everything
+		// pointing into the old mapping
+		if (load()) {
+			rewrite();
+		}
+		return written;
+	}
+
+	uint64_t ProfileStore::hashViewerParams(std::string_view viewerParams)
+	{
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for (char c : viewerParams) {
+			hash ^= (uint8_t)c;
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	// Maps and indexes the file. True if it should be rewritten.
+	bool ProfileStore::load()
+	{
+		m_profiles.clear();
+		m_index.clear();
+		m_devices.clear();
+		m_sensors.clear();
+
+		// Missing or empty is just a new store
+		if (!m_file.open(m_path)) {
+			return false;
+		}
+
+		const char* data = m_file.data();
+		size_t size = m_file.size();
+		if (size < OSVR_CARDBOARD_PROFILE_HEADER_SIZE ||
+			wire::getU32(data) != OSVR_CARDBOARD_PROFILE_MAGIC ||
+			wire::getU16(data + 4) != OSVR_CARDBOARD_PROFILE_VERSION)
+		{
+			// Nothing we can read, start over
+			return true;
+		}
+
+		size_t offset = OSVR_CARDBOARD_PROFILE_HEADER_SIZE;
+		size_t dead = 0;
+		while (size - offset >= OSVR_CARDBOARD_PROFILE_RECORD_HEADER_SIZE) {
+			const char* header = data + offset;
+			size_t configLength = wire::getU32(header);
+			size_t nameLength = wire::getU16(header + 6);
+			size_t body = size - offset - OSVR_CARDBOARD_PROFILE_RECORD_HEADER_SIZE;
+			if (body < nameLength || body - nameLength < configLength) {
+				break;
+			}
+
+			Profile profile;
+			profile.deviceName = std::string_view(header + OSVR_CARDBOARD_PROFILE_RECORD_HEADER_SIZE, nameLength);
+			profile.config = std::string_view(header + OSVR_CARDBOARD_PROFILE_RECORD_HEADER_SIZE + nameLength, configLength);
+			profile.viewerHash = wire::getU64(header + 8);
+			profile.sensor = (uint8_t)header[4];
+			profile.live = true;
+
+			auto inserted = m_index.emplace(key(profile.deviceName, profile.viewerHash), m_profiles.size());
+			if (!inserted.second) {
+				m_profiles[inserted.first->second].live = false;
+				inserted.first->second = m_profiles.size();
+				dead++;
+			}
+			m_profiles.push_back(profile);
+			offset += OSVR_CARDBOARD_PROFILE_RECORD_HEADER_SIZE + nameLength + configLength;
+		}
+
+		for (size_t i = 0; i < m_profiles.size(); i++) {
+			if (m_profiles[i].live) {
+				m_devices[std::string(m_profiles[i].deviceName)] = i;
+				m_sensors[m_profiles[i].sensor] = i;
+			}
+		}
+
+		bool torn = offset != size;
+		return torn || (dead > OSVR_CARDBOARD_PROFILE_MAX_DEAD && dead > m_index.size());
+	}
+
+	// Writes the live records alongside and swaps the file over, so a crash
+	// part way leaves the old one
+	bool ProfileStore::rewrite()
+	{
+		std::string contents(OSVR_CARDBOARD_PROFILE_HEADER_SIZE, '\0');
+		wire::putU32(&contents[0], OSVR_CARDBOARD_PROFILE_MAGIC);
+		wire::putU16(&contents[4], OSVR_CARDBOARD_PROFILE_VERSION);
+		for (const Profile& profile : m_profiles) {
+			if (profile.live) {
+				append(contents, profile);
+			}
+		}
+
+		std::string temporary = m_path + ".tmp";
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+		if (fclose(file) != 0 || !written) {
+			std::remove(temporary.c_str());
+			return false;
+		}
+
+		// Windows won't replace a mapped file, and its rename won't replace an
+		// existing one; removing it first would lose the store to a crash
+		m_file.close();
+#ifdef _WIN32
+		bool renamed = MoveFileExA(temporary.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		bool renamed = std::rename(temporary.c_str(), m_path.c_str()) == 0;
+#endif
+		load();
+		return renamed;
+	}
+
+	void ProfileStore::append(std::string& out, const Profile& profile) const
+	{
+		char header[OSVR_CARDBOARD_PROFILE_RECORD_HEADER_SIZE];
+		wire::putU32(header, (uint32_t)profile.config.size());
+		header[4] = (char)profile.sensor;
+		header[5] = 0;
+		wire::putU16(header + 6, (uint16_t)profile.deviceName.size());
+		wire::putU64(header + 8, profile.viewerHash);
+		out.append(header, sizeof(header));
+		out.append(profile.deviceName.data(), profile.deviceName.size());
+		out.append(profile.config.data(), profile.config.size());
+	}
+
+	std::string ProfileStore::key(std::string_view deviceName, uint64_t viewerHash)
+	{
+		std::string key(deviceName);
+		key += '\0';
+		char hash[8];
+		wire::putU64(hash, viewerHash);
+		key.append(hash, sizeof(hash));
+		return key;
+	}
+}
\ No newline at end of file
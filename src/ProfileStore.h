@@ -0,0 +1,100 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#define OSVR_CARDBOARD_PROFILE_MAGIC 0x53504243
+#define OSVR_CARDBOARD_PROFILE_VERSION 1
+#define OSVR_CARDBOARD_PROFILE_HEADER_SIZE 8
+#define OSVR_CARDBOARD_PROFILE_RECORD_HEADER_SIZE 16
+// Replaced records tolerated before the file is rewritten without them
+#define OSVR_CARDBOARD_PROFILE_MAX_DEAD 64
+
+/*
+	Profile store: the config each phone last sent for each viewer it's been
+	in, so that a restarted server has a viewer for every sensor before any
+	phone says a word. All fields are little-endian.
+
+		offset  size  field
+		0       4     magic, "CBPS"
+		4       2     version
+		6       2     reserved (0)
+
+	followed by records, each a fixed header, the phone's device name and its
+	config exactly as the viewerParams object it sent:
+
+		0       4     config length in bytes
+		4       1     sensor the phone was on
+		5       1     reserved (0)
+		6       2     device name length in bytes
+		8       8     viewer params hash, 64 bit FNV-1a of the base64url text
+
+	Records are only ever appended. A later record for the same device name and
+	hash replaces the earlier one, and the newest record wins when looking up a
+	device or sensor. The file is rewritten without replaced records, or a
+	record torn by a crash, when it's loaded.
+*/
+
+namespace OSVRCardboard {
+	struct ProfileConfig {
+		// Remembers every phone and viewer here, nowhere if empty
+		std::string store;
+		// Where the head tracking phone's display config is written whenever
+		// its viewer changes or is restored, nowhere if empty
+		std::string displayConfig;
+	};
+
+	/// Memory mapped store of phone and viewer profiles, indexed on load. Only
+	/// the thread that owns it may use it.
+	class ProfileStore {
+	public:
+		struct Profile {
+			std::string_view deviceName;
+			uint64_t viewerHash;
+			int sensor;
+			// The viewerParams object as the phone sent it
+			std::string_view config;
+			// Replaced by a later record
+			bool live;
+		};
+
+		bool open(const std::string& path);
+		void close();
+		bool isOpen() const { return !m_path.empty(); }
+
+		/// Distinct device and viewer pairs
+		size_t size() const { return m_index.size(); }
+
+		/// Lookups return nullptr when there's nothing stored. Profiles point
+		/// into the mapping and stay valid until the next put() or close().
+		const Profile* find(std::string_view deviceName, uint64_t viewerHash) const;
+		const Profile* lastForDevice(std::string_view deviceName) const;
+		const Profile* lastOnSensor(int sensor) const;
+
+		/// Records the config a phone sent, unless it's already the newest for
+		/// the device and sensor. False if the file can't be written.
+		bool put(int sensor, std::string_view deviceName, std::string_view viewerParams, std::string_view config);
+
+		static uint64_t hashViewerParams(std::string_view viewerParams);
+
+	private:
+		bool load();
+		bool rewrite();
+		void append(std::string& out, const Profile& profile) const;
+		static std::string key(std::string_view deviceName, uint64_t viewerHash);
+
+		std::string m_path;
+		MappedFile m_file;
+		// Every record in file order, replaced ones included
+		std::vector<Profile> m_profiles;
+		std::unordered_map<std::string, size_t> m_index;
+		std::unordered_map<std::string, size_t> m_devices;
+		std::unordered_map<int, size_t> m_sensors;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "osvr/Util/QuaternionC.h"
+
+#include <cmath>
+
+namespace OSVRCardboard {
+	struct Vec3 {
+		double x, y, z;
+	};
+
+	struct Quat {
+		double w, x, y, z;
+	};
+
+	inline Quat toQuat(const OSVR_Quaternion& q)
+	{
+		return Quat{ osvrQuatGetW(&q), osvrQuatGetX(&q), osvrQuatGetY(&q), osvrQuatGetZ(&q) };
+	}
+
+	inline OSVR_Quaternion toOsvr(const Quat& q)
+	{
+		OSVR_Quaternion result;
+		osvrQuatSetW(&result, q.w);
+		osvrQuatSetX(&result, q.x);
+		osvrQuatSetY(&result, q.y);
+		osvrQuatSetZ(&result, q.z);
+		return result;
+	}
+
+	inline Quat quatMultiply(const Quat& a, const Quat& b)
+	{
+		return Quat{
+			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+			a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+		};
+	}
+
+	inline Quat quatConjugate(const Quat& q)
+	{
+		return Quat{ q.w, -q.x, -q.y, -q.z };
+	}
+
+	inline double quatDot(const Quat& a, const Quat& b)
+	{
+		return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline Quat quatNormalize(const Quat& q)
+	{
+		double norm = sqrt(quatDot(q, q));
+		if (norm == 0) return Quat{ 1, 0, 0, 0 };
+		return Quat{ q.w / norm, q.x / norm, q.y / norm, q.z / norm };
+	}
+
+	/// v rotated by the unit quaternion q, i.e. q v q*
+	inline Vec3 quatRotate(const Quat& q, const Vec3& v)
+	{
+		Quat rotated = quatMultiply(quatMultiply(q, Quat{ 0, v.x, v.y, v.z }), quatConjugate(q));
+		return Vec3{ rotated.x, rotated.y, rotated.z };
+	}
+
+	/// Rotation vector (axis * angle, radians) of a unit quaternion, taking the
+	/// short way round
+	inline Vec3 quatLog(const Quat& q)
+	{
+		Quat h = q.w < 0 ? Quat{ -q.w, -q.x, -q.y, -q.z } : q;
+		double sinHalf = sqrt(h.x * h.x + h.y * h.y + h.z * h.z);
+		if (sinHalf < 1e-12) {
+			return Vec3{ 2 * h.x, 2 * h.y, 2 * h.z };
+		}
+		double scale = 2 * atan2(sinHalf, h.w) / sinHalf;
+		return Vec3{ h.x * scale, h.y * scale, h.z * scale };
+	}
+
+	/// Unit quaternion for a rotation vector (axis * angle, radians)
+	inline Quat quatExp(const Vec3& v)
+	{
+		double angle = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+		if (angle < 1e-12) {
+			return quatNormalize(Quat{ 1, v.x / 2, v.y / 2, v.z / 2 });
+		}
+		double scale = sin(angle / 2) / angle;
+		return Quat{ cos(angle / 2), v.x * scale, v.y * scale, v.z * scale };
+	}
+
+	inline Quat quatSlerp(const Quat& a, const Quat& b, double t)
+	{
+		Quat target = quatDot(a, b) < 0 ? Quat{ -b.w, -b.x, -b.y, -b.z } : b;
+		Vec3 delta = quatLog(quatMultiply(quatConjugate(a), target));
+		return quatMultiply(a, quatExp(Vec3{ delta.x * t, delta.y * t, delta.z * t }));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "SampleDelivery.h"
+#include "Quaternion.h"
+
+namespace OSVRCardboard {
+
+	SampleDelivery::SampleDelivery(const DeliveryConfig& config) : m_config(config) {}
+
+	size_t SampleDelivery::select(const TimestampedQuaternion* samples, size_t count, const OSVR_TimeValue& tick, TimestampedQuaternion* out)
+	{
+		switch (m_config.policy) {
+		case DeliveryPolicy::Latest:
+			if (!count) return 0;
+			out[0] = samples[count - 1];
+			return 1;
+
+		case DeliveryPolicy::Resampled:
+			for (size_t i = 0; i < count; i++) {
+				if (m_window.empty() || toMicroseconds(samples[i].timestamp) > toMicroseconds(m_window.back().timestamp)) {
+					m_window.push_back(samples[i]);
+				}
+			}
+			return resample(tick, out);
+
+		case DeliveryPolicy::All:
+		default:
+			for (size_t i = 0; i < count; i++) {
+				out[i] = samples[i];
+			}
+			return count;
+		}
+	}
+
+	size_t SampleDelivery::resample(const OSVR_TimeValue& tick, TimestampedQuaternion* out)
+	{
+		if (m_window.empty()) {
+			return 0;
+		}
+
+		int64_t target = toMicroseconds(tick) - (int64_t)(m_config.resampleDelay * 1e6);
+
+		// Newest sample at or before the target
+		size_t before = 0;
+		while (before + 1 < m_window.size() && toMicroseconds(m_window[before + 1].timestamp) <= target) {
+			before++;
+		}
+		m_window.erase(m_window.begin(), m_window.begin() + before);
+
+		const TimestampedQuaternion& a = m_window[0];
+		int64_t timeA = toMicroseconds(a.timestamp);
+		TimestampedQuaternion result;
+
+		if (target <= timeA || m_window.size() == 1) {
+			// Nothing to interpolate towards: hold the closest sample
+			result = a;
+		}
+		else {
+			const TimestampedQuaternion& b = m_window[1];
+			double t = (double)(target - timeA) / (double)(toMicroseconds(b.timestamp) - timeA);
+			result.quaternion = toOsvr(quatSlerp(toQuat(a.quaternion), toQuat(b.quaternion), t));
+			result.timestamp = fromMicroseconds(target);
+		}
+
+		// Never report the same instant twice, or go backwards
+		int64_t time = toMicroseconds(result.timestamp);
+		if (time <= m_last_delivered) {
+			return 0;
+		}
+		m_last_delivered = time;
+		out[0] = result;
+		return 1;
+	}
+
+	void SampleDelivery::reset()
+	{
+		m_window.clear();
+		m_last_delivered = INT64_MIN;
+	}
+}
\ No newline at end of file
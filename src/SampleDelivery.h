@@ -0,0 +1,45 @@
+#pragma once
+
+#include "TrackingTypes.h"
+
+#include <vector>
+
+namespace OSVRCardboard {
+	enum class DeliveryPolicy {
+		// Every sample, in order
+		All,
+		// Only the newest sample of each batch
+		Latest,
+		// One sample per tick, interpolated at a fixed delay behind the tick
+		Resampled
+	};
+
+	struct DeliveryConfig {
+		DeliveryPolicy policy = DeliveryPolicy::All;
+		// Seconds. How far behind the tick resampling looks, so that there is
+		// usually a newer sample to interpolate towards.
+		double resampleDelay = 0.01;
+	};
+
+	/// Reduces each batch of samples drained from the TrackingServer to what
+	/// gets reported to OSVR on this update tick
+	class SampleDelivery {
+	public:
+		SampleDelivery(const DeliveryConfig& config = DeliveryConfig());
+
+		/// samples are oldest first. Returns the number written to out, which
+		/// needs room for count samples.
+		size_t select(const TimestampedQuaternion* samples, size_t count, const OSVR_TimeValue& tick, TimestampedQuaternion* out);
+
+		/// Forgets the history, for when a different phone takes the sensor
+		void reset();
+
+	private:
+		size_t resample(const OSVR_TimeValue& tick, TimestampedQuaternion* out);
+
+		DeliveryConfig m_config;
+		// Resampling history, oldest first, pruned as the target time moves on
+		std::vector<TimestampedQuaternion> m_window;
+		int64_t m_last_delivered = INT64_MIN;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#define OSVR_CARDBOARD_CACHE_LINE 64
+
+namespace OSVRCardboard {
+	enum class OverflowPolicy {
+		DropOldest,
+		DropNewest
+	};
+
+	/// Bounded single-producer/single-consumer ring buffer.
+	///
+	/// With DropNewest both sides are wait-free: a push into a full ring is
+	/// discarded. With DropOldest the producer instead claims the oldest slot
+	/// from under the consumer, so the consumer validates each copy with a CAS
+	/// on the head index and retries if the slot was taken while it was reading.
+	/// T must be trivially copyable.
+	template <typename T>
+	class SampleRing {
+	public:
+		SampleRing(size_t capacity = 256, OverflowPolicy policy = OverflowPolicy::DropOldest)
+		{
+			configure(capacity, policy);
+		}
+
+		/// Not thread safe: only call before the producer and consumer start
+		void configure(size_t capacity, OverflowPolicy policy)
+		{
+			size_t size = 2;
+			while (size < capacity) size <<= 1;
+
+			m_slots.assign(size, T());
+			m_mask = size - 1;
+			m_policy = policy;
+			m_head.store(0);
+			m_tail.store(0);
+			m_dropped.store(0);
+		}
+
+		/// Producer side. Returns false if a sample had to be dropped.
+		bool push(const T& value)
+		{
+			uint64_t tail = m_tail.load(std::memory_order_relaxed);
+			uint64_t head = m_head.load(std::memory_order_acquire);
+			bool dropped = false;
+
+			if (tail - head > m_mask) {
+				if (m_policy == OverflowPolicy::DropNewest) {
+					m_dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				// If this fails the consumer has just freed the slot itself
+				if (m_head.compare_exchange_strong(head, head + 1, std::memory_order_acq_rel)) {
+					m_dropped.fetch_add(1, std::memory_order_relaxed);
+					dropped = true;
+				}
+			}
+
+			m_slots[tail & m_mask] = value;
+			m_tail.store(tail + 1, std::memory_order_release);
+			return !dropped;
+		}
+
+		/// Consumer side. Returns false if the ring is empty.
+		bool pop(T& value)
+		{
+			uint64_t head = m_head.load(std::memory_order_acquire);
+			while (true) {
+				if (head == m_tail.load(std::memory_order_acquire)) {
+					return false;
+				}
+				value = m_slots[head & m_mask];
+
+				if (m_policy == OverflowPolicy::DropNewest) {
+					m_head.store(head + 1, std::memory_order_release);
+					return true;
+				}
+				if (m_head.compare_exchange_strong(head, head + 1, std::memory_order_acq_rel)) {
+					return true;
+				}
+			}
+		}
+
+		/// Consumer side. Pops up to max samples, oldest first, claiming them
+		/// all with a single update of the head index.
+		size_t pop(T* values, size_t max)
+		{
+			uint64_t head = m_head.load(std::memory_order_acquire);
+			while (true) {
+				uint64_t available = m_tail.load(std::memory_order_acquire) - head;
+				size_t count = available < max ? (size_t)available : max;
+				if (!count) {
+					return 0;
+				}
+				for (size_t i = 0; i < count; i++) {
+					values[i] = m_slots[(head + i) & m_mask];
+				}
+
+				if (m_policy == OverflowPolicy::DropNewest) {
+					m_head.store(head + count, std::memory_order_release);
+					return count;
+				}
+				if (m_head.compare_exchange_strong(head, head + count, std::memory_order_acq_rel)) {
+					return count;
+				}
+			}
+		}
+
+		bool empty() const
+		{
+			return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+		}
+
+		size_t size() const
+		{
+			uint64_t head = m_head.load(std::memory_order_acquire);
+			uint64_t tail = m_tail.load(std::memory_order_acquire);
+			return tail > head ? (size_t)(tail - head) : 0;
+		}
+
+		size_t capacity() const
+		{
+			return m_mask + 1;
+		}
+
+		uint64_t dropped() const
+		{
+			return m_dropped.load(std::memory_order_relaxed);
+		}
+
+	private:
+		alignas(OSVR_CARDBOARD_CACHE_LINE) std::atomic<uint64_t> m_head;
+		alignas(OSVR_CARDBOARD_CACHE_LINE) std::atomic<uint64_t> m_tail;
+		alignas(OSVR_CARDBOARD_CACHE_LINE) std::atomic<uint64_t> m_dropped;
+		alignas(OSVR_CARDBOARD_CACHE_LINE) std::vector<T> m_slots;
+		size_t m_mask;
+		OverflowPolicy m_policy;
+	};
+}
\ No newline at end of file
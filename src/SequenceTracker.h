@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+namespace OSVRCardboard {
+	/// Tracks the sequence numbers of an unreliable, unordered stream so that
+	/// only samples newer than everything already delivered get through.
+	/// Comparisons are wrap-around safe.
+	class SequenceTracker {
+	public:
+		/// True if sequence is the newest seen so far and should be delivered
+		bool accept(uint32_t sequence)
+		{
+			if (!m_started) {
+				m_started = true;
+				m_highest = sequence;
+				return true;
+			}
+
+			int32_t delta = (int32_t)(sequence - m_highest);
+			if (delta > 0) {
+				m_lost += delta - 1;
+				m_highest = sequence;
+				return true;
+			}
+
+			// Late or duplicate. A late one was counted as lost when the gap opened.
+			m_reordered++;
+			if (delta < 0 && m_lost > 0) {
+				m_lost--;
+			}
+			return false;
+		}
+
+		void reset()
+		{
+			m_started = false;
+			m_highest = 0;
+			m_lost = 0;
+			m_reordered = 0;
+		}
+
+		uint64_t lost() const { return m_lost; }
+		uint64_t reordered() const { return m_reordered; }
+
+	private:
+		bool m_started = false;
+		uint32_t m_highest = 0;
+		uint64_t m_lost = 0;
+		uint64_t m_reordered = 0;
+	};
+}
\ No newline at end of file
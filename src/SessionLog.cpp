@@ -0,0 +1,147 @@
+#include "SessionLog.h"
+#include "WireProtocol.h"
+
+namespace OSVRCardboard {
+	namespace session {
+
+		SessionWriter::~SessionWriter()
+		{
+			close();
+		}
+
+		bool SessionWriter::open(const std::string& path)
+		{
+			close();
+
+			m_file = fopen(path.c_str(), "ab");
+			if (!m_file) {
+				return false;
+			}
+			setvbuf(m_file, nullptr, _IOFBF, OSVR_CARDBOARD_LOG_BUFFER_SIZE);
+
+			char header[OSVR_CARDBOARD_LOG_HEADER_SIZE];
+			wire::putU32(header, OSVR_CARDBOARD_LOG_MAGIC);
+			wire::putU16(header + 4, OSVR_CARDBOARD_LOG_VERSION);
+			wire::putU16(header + 6, 0);
+			fwrite(header, 1, sizeof(header), m_file);
+			return true;
+		}
+
+		void SessionWriter::close()
+		{
+			if (m_file) {
+				fclose(m_file);
+				m_file = nullptr;
+			}
+		}
+
+		void SessionWriter::flush()
+		{
+			if (m_file) {
+				fflush(m_file);
+			}
+		}
+
+		void SessionWriter::write(uint8_t type, int sensor, int64_t time, const char* data, size_t length)
+		{
+			if (!m_file) {
+				return;
+			}
+
+			char header[OSVR_CARDBOARD_LOG_RECORD_HEADER_SIZE];
+			wire::putU32(header, (uint32_t)length);
+			header[4] = (char)type;
+			header[5] = (char)sensor;
+			wire::putU16(header + 6, 0);
+			wire::putU64(header + 8, (uint64_t)time);
+
+			fwrite(header, 1, sizeof(header), m_file);
+			if (length) {
+				fwrite(data, 1, length, m_file);
+			}
+		}
+
+		void SessionWriter::writeSample(int sensor, int64_t time, const TimestampedQuaternion& sample)
+		{
+			if (!m_file) {
+				return;
+			}
+
+			char payload[SamplePayloadSize];
+			wire::putF32(payload, (float)osvrQuatGetX(&sample.quaternion));
+			wire::putF32(payload + 4, (float)osvrQuatGetY(&sample.quaternion));
+			wire::putF32(payload + 8, (float)osvrQuatGetZ(&sample.quaternion));
+			wire::putF32(payload + 12, (float)osvrQuatGetW(&sample.quaternion));
+			wire::putU64(payload + 16, (uint64_t)toMicroseconds(sample.timestamp));
+			write(Sample, sensor, time, payload, sizeof(payload));
+		}
+
+		bool SessionReader::open(const std::string& path)
+		{
+			m_offset = 0;
+			return m_file.open(path);
+		}
+
+		void SessionReader::close()
+		{
+			m_file.close();
+			m_offset = 0;
+		}
+
+		void SessionReader::rewind()
+		{
+			m_offset = 0;
+		}
+
+		bool SessionReader::next(Record& record)
+		{
+			const char* data = m_file.data();
+			size_t size = m_file.size();
+
+			while (true) {
+				if (size - m_offset < OSVR_CARDBOARD_LOG_HEADER_SIZE) {
+					return false;
+				}
+
+				// Skip the file header at the start of each session
+				if (wire::getU32(data + m_offset) == OSVR_CARDBOARD_LOG_MAGIC) {
+					if (wire::getU16(data + m_offset + 4) != OSVR_CARDBOARD_LOG_VERSION) {
+						return false;
+					}
+					m_offset += OSVR_CARDBOARD_LOG_HEADER_SIZE;
+					continue;
+				}
+
+				if (size - m_offset < OSVR_CARDBOARD_LOG_RECORD_HEADER_SIZE) {
+					return false;
+				}
+				const char* header = data + m_offset;
+				size_t length = wire::getU32(header);
+				if (size - m_offset - OSVR_CARDBOARD_LOG_RECORD_HEADER_SIZE < length) {
+					return false;
+				}
+
+				record.type = (uint8_t)header[4];
+				record.sensor = (uint8_t)header[5];
+				record.time = (int64_t)wire::getU64(header + 8);
+				record.data = header + OSVR_CARDBOARD_LOG_RECORD_HEADER_SIZE;
+				record.length = length;
+				m_offset += OSVR_CARDBOARD_LOG_RECORD_HEADER_SIZE + length;
+				return true;
+			}
+		}
+
+		bool SessionReader::decodeSample(const Record& record, TimestampedQuaternion& sample)
+		{
+			if (record.type != Sample || record.length < SamplePayloadSize) {
+				return false;
+			}
+			osvrQuatSetX(&sample.quaternion, wire::getF32(record.data));
+			osvrQuatSetY(&sample.quaternion, wire::getF32(record.data + 4));
+			osvrQuatSetZ(&sample.quaternion, wire::getF32(record.data + 8));
+			osvrQuatSetW(&sample.quaternion, wire::getF32(record.data + 12));
+			sample.timestamp = fromMicroseconds((int64_t)wire::getU64(record.data + 16));
+			return true;
+		}
+	}
+}
\ No newline at end of file
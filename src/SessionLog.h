@@ -0,0 +1,111 @@
+#pragma once
+
+#include "TrackingTypes.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define OSVR_CARDBOARD_LOG_MAGIC 0x4C524243
+#define OSVR_CARDBOARD_LOG_VERSION 1
+#define OSVR_CARDBOARD_LOG_HEADER_SIZE 8
+#define OSVR_CARDBOARD_LOG_RECORD_HEADER_SIZE 16
+#define OSVR_CARDBOARD_LOG_BUFFER_SIZE 65536
+
+/*
+	Session log: everything a TrackingServer received, in order, so that it can
+	be fed back through the same path later. All fields are little-endian.
+
+		offset  size  field
+		0       4     magic, "CBRL"
+		4       2     version
+		6       2     reserved (0)
+
+	followed by records, each a fixed header and its data:
+
+		0       4     data length in bytes
+		4       1     record type
+		5       1     sensor
+		6       2     reserved (0)
+		8       8     receive time (microseconds, server clock)
+
+	A file can hold several sessions back to back, each starting with its own
+	file header.
+*/
+
+namespace OSVRCardboard {
+	struct SessionConfig {
+		// Log everything received to this file
+		std::string record;
+		// Replay this log instead of listening for phones
+		std::string replay;
+		// Keep the recorded timing, or go as fast as possible
+		bool realtime = true;
+		bool loop = false;
+	};
+
+	namespace session {
+		enum RecordType : uint8_t {
+			// A phone took the sensor. No data.
+			Connect = 1,
+			// The phone went away. No data.
+			Disconnect = 2,
+			// Bytes exactly as read from the phone's TCP connection
+			Stream = 3,
+			// One UDP datagram, session id prefix included
+			Datagram = 4,
+			// A decoded sample as it was queued for OSVR, timestamp translated
+			// if that was enabled: float x, y, z, w; int64 timestamp
+			Sample = 5
+		};
+
+		const size_t SamplePayloadSize = 24;
+
+		struct Record {
+			uint8_t type;
+			uint8_t sensor;
+			int64_t time;
+			const char* data;
+			size_t length;
+		};
+
+		/// Appends to a log through a large buffer. Only the thread that owns
+		/// it may write.
+		class SessionWriter {
+		public:
+			~SessionWriter();
+
+			bool open(const std::string& path);
+			void close();
+			bool isOpen() const { return m_file != nullptr; }
+			void flush();
+
+			void write(uint8_t type, int sensor, int64_t time, const char* data = nullptr, size_t length = 0);
+			void writeSample(int sensor, int64_t time, const TimestampedQuaternion& sample);
+
+		private:
+			FILE* m_file = nullptr;
+		};
+
+		/// Walks the records of a memory mapped log. Records point into the
+		/// mapping and stay valid until the reader is closed.
+		class SessionReader {
+		public:
+			bool open(const std::string& path);
+			void close();
+			bool isOpen() const { return m_file.isOpen(); }
+
+			/// False at the end of the log, or at a truncated record
+			bool next(Record& record);
+			void rewind();
+
+			static bool decodeSample(const Record& record, TimestampedQuaternion& sample);
+
+		private:
+			MappedFile m_file;
+			size_t m_offset = 0;
+		};
+	}
+}
\ No newline at end of file
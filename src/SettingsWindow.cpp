@@ -1,6 +1,5 @@
 #include "SettingsWindow.h"
 #include "TrackingServer.h"
-#include "je_nourish_cardboard_json.h"
 
 #include <json/json.h>
 
@@ -13,6 +12,10 @@
 namespace OSVRCardboard {
 
 	TrackingServer *server = NULL;
+	DistortionMeshConfig distortionMesh;
+	InverseDistortionConfig inverseDistortion;
+	std::string displayConfigPath;
+	bool wasReady = true;
 
 	DWORD resolutions[2][3] = {
 		{ 1920, 1080, 32 },
@@ -20,59 +23,48 @@ namespace OSVRCardboard {
 	};
 	DEVMODE _devmode;
 
-	SettingsWindow::SettingsWindow(OSVR_PluginRegContext ctx) : mContext(ctx)
+	void logInverseError(double inverseError)
 	{
-		m_ui_thread = new std::thread(SettingsWindow::ui_thread, std::ref(m_ui_thread_data));
-
-		OSVR_DeviceInitOptions opts = osvrDeviceCreateInitOptions(ctx);
-
-		osvrDeviceTrackerConfigure(opts, &mTracker);
-
-		/// Create the device token with the options
-		mDev.initAsync(ctx, "GoogleCardboard", opts);
-
-		/// Send JSON descriptor
-		mDev.sendJsonDescriptor(je_nourish_cardboard_json);
+		if (inverseError >= 0) {
+			std::cout << "OSVR Cardboard: Inverse distortion fit to order " << inverseDistortion.order
+				<< ", max error " << inverseError << " degrees" << std::endl;
+		}
+	}
 
-		/// Register update callback
-		mDev.registerUpdateCallback(this);
+	SettingsWindow::SettingsWindow(TrackingServer& server, const TrackingConfig& config)
+	{
+		m_ui_thread_data.server = &server;
+		m_ui_thread_data.config = config;
+		m_ui_thread = new std::thread(SettingsWindow::ui_thread, std::ref(m_ui_thread_data));
 	}
 
 	SettingsWindow::~SettingsWindow()
 	{
 		m_ui_thread_data.end = true;
-		m_ui_thread->join();
-	}
-
-	OSVR_ReturnCode SettingsWindow::update() {
-		TimestampedQuaternion q;
-		
-		while (server && server->hasQuaternion())
-		{
-			q = server->quaternion();
-			osvrDeviceTrackerSendOrientationTimestamped(mDev, mTracker, &q.quaternion, 0, &q.timestamp);
+		// If the dialog doesn't exist yet, the thread sees end before it waits
+		HWND window = m_ui_thread_data.window;
+		if (window) {
+			PostMessage(window, WM_SERVER_CHANGED, 0, 0);
 		}
-
-		return OSVR_RETURN_SUCCESS;
+		m_ui_thread->join();
+		delete m_ui_thread;
 	}
 
 	void SettingsWindow::ui_thread(ui_thread_data& data)
 	{
 		MSG msg;
-		BOOL ret;
 		HWND hDlg;
 		HINSTANCE hInst;
 
-		server = new TrackingServer();
-
-		bool wasReady = true;
-		bool isReady = false;
+		server = data.server;
+		distortionMesh = data.config.distortionMesh;
+		inverseDistortion = data.config.inverseDistortion;
+		displayConfigPath = data.config.profiles.displayConfig;
 
 		hInst = GetModuleHandle("je_nourish_cardboard.dll");
 		hDlg = CreateDialogParam(hInst, MAKEINTRESOURCE(IDD_DIALOG1), 0, DialogProc, 0);
 		ShowWindow(hDlg, SW_RESTORE);
 		CheckRadioButton(hDlg, IDC_RADIO1, IDC_RADIO2, IDC_RADIO1);
-		HWND hConnButton = GetDlgItem(hDlg, IDC_DISCONNECT);
 
 		EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &_devmode);
 		resolutions[0][0] = _devmode.dmPelsWidth;
@@ -88,61 +80,84 @@ namespace OSVRCardboard {
 
 		UpdateWindow(hDlg);
 
+		// Sleep in GetMessage until there's input or the server has news,
+		// rather than polling it
+		server->setChangeListener([hDlg] { PostMessage(hDlg, WM_SERVER_CHANGED, 0, 0); });
+		data.window = hDlg;
+		refresh(hDlg);
 
-		do {
-			if (ret = PeekMessage(&msg, 0, 0, 0, PM_REMOVE)) {
-				if (!IsDialogMessage(hDlg, &msg)) {
-					TranslateMessage(&msg);
-					DispatchMessage(&msg);
-				}
+		while (!data.end && GetMessage(&msg, 0, 0, 0) > 0) {
+			if (!IsDialogMessage(hDlg, &msg)) {
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
 			}
+		}
 
-			isReady = server->isReady();
-			if (isReady && !wasReady) {
-				ShowWindow(hConnButton, SW_SHOW);
-				SetDlgItemText(hDlg, IDC_CONNECTION_STATUS, server->getStatus());
-				UpdateWindow(hConnButton);
+		server->setChangeListener(nullptr);
+		DestroyWindow(hDlg);
+	}
+
+	void SettingsWindow::refresh(HWND hDlg)
+	{
+		HWND hConnButton = GetDlgItem(hDlg, IDC_DISCONNECT);
+		bool isReady = server->isReady();
+
+		SetDlgItemText(hDlg, IDC_CONNECTION_STATUS, server->getStatus());
+		if (isReady && !wasReady) {
+			ShowWindow(hConnButton, SW_SHOW);
+			UpdateWindow(hConnButton);
+		}
+		else if (!isReady && wasReady) {
+			ShowWindow(hConnButton, SW_HIDE);
+			UpdateWindow(hConnButton);
+		}
+		wasReady = isReady;
+
+		// Not only while a phone is connected: a viewer restored from the
+		// profile store arrives while the server is still waiting
+		if (server->configChanged()) {
+			std::shared_ptr<const Viewer> viewer = server->config();
+			if (viewer->hasMagnet()) {
+				MessageBox(hDlg, "Warning: This viewer device contains magnets which may interfere with orientation tracking.",
+					"OSVR Cardboard", MB_OK);
 			}
-			else if (!isReady && wasReady) {
-				SetDlgItemText(hDlg, IDC_CONNECTION_STATUS, server->getStatus());
-				ShowWindow(hConnButton, SW_HIDE);
-				UpdateWindow(hConnButton);
+			std::string viewerName = viewer->vendor() + " " + viewer->model();
+			if (viewerName.length() == 1) {
+				viewerName = "No viewer - scan QR code";
 			}
-			wasReady = isReady;
-
-			if (isReady) {
-				if (server->configChanged()) {
-					Viewer viewer = server->config();
-					if (viewer.hasMagnet()) {
-						MessageBox(hDlg, "Warning: This viewer device contains magnets which may interfere with orientation tracking.",
-							"OSVR Cardboard", MB_OK);
-					}
-					std::string viewerName = viewer.vendor() + " " + viewer.model();
-					if (viewerName.length() == 1) {
-						viewerName = "No viewer - scan QR code";
-					}
-					else {
-						viewerName.append(" - " + viewer.name());
-					}
-					SetDlgItemText(hDlg, IDC_CONFIGURATION_STATUS, viewerName.c_str());
-					EnableWindow(GetDlgItem(hDlg, IDC_SAVE_CONFIGURATION), true);
-
-					viewer.resolution(resolutions[1]);
-					viewerResolution = "Viewer resolution (" + std::to_string(resolutions[1][0]) + "x" + std::to_string(resolutions[1][1]) + ")";
-					SetDlgItemText(hDlg, IDC_RADIO2, viewerResolution.c_str());
+			else {
+				viewerName.append(" - " + viewer->name());
+			}
+			SetDlgItemText(hDlg, IDC_CONFIGURATION_STATUS, viewerName.c_str());
+			EnableWindow(GetDlgItem(hDlg, IDC_SAVE_CONFIGURATION), true);
+
+			// Saves clicking Save every time the viewer changes
+			if (!displayConfigPath.empty()) {
+				double inverseError;
+				if (viewer->writeDisplayConfig(displayConfigPath, distortionMesh, inverseDistortion, &inverseError)) {
+					logInverseError(inverseError);
+				}
+				else {
+					std::cout << "OSVR Cardboard: Can't write display config to " << displayConfigPath << std::endl;
 				}
 			}
 
-			if (data.end) break;
-		} while (true);
-
-		DestroyWindow(hDlg);
+			viewer->resolution(resolutions[1]);
+			std::string viewerResolution = "Viewer resolution (" + std::to_string(resolutions[1][0]) + "x" + std::to_string(resolutions[1][1]) + ")";
+			SetDlgItemText(hDlg, IDC_RADIO2, viewerResolution.c_str());
+		}
 	}
 
 	INT_PTR CALLBACK SettingsWindow::DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	{
 		switch (uMsg)
 		{
+		case WM_SERVER_CHANGED:
+			// Handled here rather than in the message loop so it still arrives
+			// while a message box is up
+			refresh(hDlg);
+			return TRUE;
+
 		case WM_COMMAND:
 			switch (LOWORD(wParam))
 			{
@@ -180,7 +195,7 @@ namespace OSVRCardboard {
 
 	void SettingsWindow::saveConfig(HWND hDlg)
 	{
-		Viewer viewer = server->config();
+		std::shared_ptr<const Viewer> viewer = server->config();
 
 		HRESULT hr;
 		CComPtr<IFileSaveDialog> pDlg;
@@ -194,8 +209,10 @@ namespace OSVRCardboard {
 		if (FAILED(hr))
 			return;
 
-		std::string filename = viewer.model().append("-" + viewer.name()).append(".json");
-		std::string contents = viewer.displayConfig();
+		std::string filename = viewer->model().append("-" + viewer->name()).append(".json");
+		double inverseError;
+		std::string contents = viewer->displayConfig(distortionMesh, inverseDistortion, &inverseError);
+		logInverseError(inverseError);
 
 		pDlg->SetFileTypes(_countof(aFileTypes), aFileTypes);
 		pDlg->SetTitle(L"Save OSVR display config");
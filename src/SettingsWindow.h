@@ -1,41 +1,42 @@
 #pragma once
 
 #include "TrackingServer.h"
+#include "TrackingConfig.h"
 #include "Viewer.h"
 
 #include <thread>
-#include <mutex>
+#include <atomic>
 
 #include <Windows.h>
 #include <windowsx.h>
 #include <tchar.h>
 #include "resource.h"
 
-#include <osvr/PluginKit/PluginKit.h>
-#include <osvr/PluginKit/TrackerInterfaceC.h>
+// Posted to the dialog by the server's change listener
+#define WM_SERVER_CHANGED (WM_APP + 1)
 
 namespace OSVRCardboard {
 	struct ui_thread_data
 	{
-		bool end = false;
+		std::atomic<bool> end{ false };
+		// Set once the dialog exists, for waking it to shut down
+		std::atomic<HWND> window{ NULL };
+		TrackingServer* server;
+		TrackingConfig config;
 	};
 
 	class SettingsWindow {
 	public:
-		SettingsWindow(OSVR_PluginRegContext ctx);
+		SettingsWindow(TrackingServer& server, const TrackingConfig& config);
 		~SettingsWindow();
 
-		OSVR_ReturnCode update();
-
 		static void ui_thread(ui_thread_data& data);
 		static INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
 	private:
 		std::thread *m_ui_thread;
 		ui_thread_data m_ui_thread_data;
-		osvr::pluginkit::PluginContext mContext;
-		osvr::pluginkit::DeviceToken mDev;
-		OSVR_TrackerDeviceInterface mTracker;
 
+		static void refresh(HWND hDlg);
 		static void saveConfig(HWND hDlg);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#ifdef _WIN32
+
+#define _WINSOCKAPI_
+
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#pragma comment(lib,"ws2_32.lib")
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+typedef int SOCKET;
+typedef struct sockaddr SOCKADDR;
+typedef struct sockaddr_in SOCKADDR_IN;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define SD_BOTH SHUT_RDWR
+#define closesocket ::close
+
+#endif
+
+namespace OSVRCardboard {
+	namespace net {
+		// Winsock needs explicit (reference counted) initialisation, POSIX doesn't
+		inline bool startup()
+		{
+#ifdef _WIN32
+			WSADATA WsaDat;
+			return WSAStartup(MAKEWORD(2, 2), &WsaDat) == 0;
+#else
+			return true;
+#endif
+		}
+
+		inline void cleanup()
+		{
+#ifdef _WIN32
+			WSACleanup();
+#endif
+		}
+
+		inline bool setNonBlocking(SOCKET s)
+		{
+#ifdef _WIN32
+			u_long mode = 1;
+			return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+			int flags = fcntl(s, F_GETFL, 0);
+			return flags != -1 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+		}
+
+		// Sends small writes straight away rather than holding them back to
+		// coalesce with the next, at the cost of more packets
+		inline bool setNoDelay(SOCKET s)
+		{
+			int enable = 1;
+			return setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable)) == 0;
+		}
+
+		// True if the last failed call only failed because it would have blocked
+		inline bool wouldBlock()
+		{
+#ifdef _WIN32
+			return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+		}
+
+		// Never raises SIGPIPE if the peer has already gone
+		inline int send(SOCKET s, const char* data, int length)
+		{
+#ifdef MSG_NOSIGNAL
+			return ::send(s, data, length, MSG_NOSIGNAL);
+#else
+			return ::send(s, data, length, 0);
+#endif
+		}
+
+		inline void closeSocket(SOCKET s)
+		{
+			shutdown(s, SD_BOTH);
+			closesocket(s);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "StreamFramer.h"
+
+#include <cstring>
+
+namespace OSVRCardboard {
+
+	StreamFramer::StreamFramer(size_t maxFrameSize) : m_max_frame_size(maxFrameSize) {}
+
+	char* StreamFramer::prepare(size_t size)
+	{
+		if (m_buffer.size() - m_end < size && m_begin > 0) {
+			memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+			m_end -= m_begin;
+			m_scanned -= m_begin;
+			m_begin = 0;
+		}
+		if (m_buffer.size() - m_end < size) {
+			size_t capacity = m_buffer.size() ? m_buffer.size() * 2 : TS_FRAMER_INITIAL_SIZE;
+			while (capacity - m_end < size) capacity *= 2;
+			m_buffer.resize(capacity);
+		}
+		return m_buffer.data() + m_end;
+	}
+
+	void StreamFramer::commit(size_t size)
+	{
+		m_end += size;
+	}
+
+	FrameStatus StreamFramer::nextLine(std::string_view& line)
+	{
+		while (true) {
+			char* begin = m_buffer.data() + m_begin;
+			char* delimiter = m_scanned < m_end ? (char*)memchr(m_buffer.data() + m_scanned, '\n', m_end - m_scanned) : nullptr;
+
+			if (!delimiter) {
+				m_scanned = m_end;
+				if (m_discarding || m_end - m_begin > m_max_frame_size) {
+					if (!m_discarding) m_oversized++;
+					m_discarding = true;
+					m_begin = m_scanned = m_end = 0;
+				}
+				return FrameStatus::NeedMore;
+			}
+
+			size_t next = delimiter - m_buffer.data() + 1;
+			size_t length = delimiter - begin;
+			m_begin = m_scanned = next;
+
+			if (m_discarding) {
+				m_discarding = false;
+				continue;
+			}
+			if (length > m_max_frame_size) {
+				m_oversized++;
+				continue;
+			}
+
+			if (length && begin[length - 1] == '\r') length--;
+			begin[length] = 0;
+			line = std::string_view(begin, length);
+			return FrameStatus::Ok;
+		}
+	}
+
+	FrameStatus StreamFramer::nextFrame(wire::Header& header, std::string_view& payload)
+	{
+		const char* begin = m_buffer.data() + m_begin;
+		wire::DecodeStatus status = wire::decodeHeader(begin, m_end - m_begin, header);
+
+		if (status == wire::DecodeStatus::Invalid) {
+			return FrameStatus::Invalid;
+		}
+		if (m_end - m_begin >= OSVR_CARDBOARD_WIRE_HEADER_SIZE &&
+			OSVR_CARDBOARD_WIRE_HEADER_SIZE + (size_t)header.length > m_max_frame_size)
+		{
+			return FrameStatus::Invalid;
+		}
+		if (status == wire::DecodeStatus::NeedMore) {
+			return FrameStatus::NeedMore;
+		}
+
+		payload = std::string_view(begin + OSVR_CARDBOARD_WIRE_HEADER_SIZE, header.length);
+		m_begin += OSVR_CARDBOARD_WIRE_HEADER_SIZE + header.length;
+		m_scanned = m_begin;
+		return FrameStatus::Ok;
+	}
+
+	size_t StreamFramer::buffered() const
+	{
+		return m_end - m_begin;
+	}
+
+	uint64_t StreamFramer::oversized() const
+	{
+		return m_oversized;
+	}
+
+	void StreamFramer::clear()
+	{
+		m_begin = m_end = m_scanned = 0;
+		m_discarding = false;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "WireProtocol.h"
+
+#include <vector>
+#include <string_view>
+#include <cstdint>
+
+#define TS_MAX_FRAME_SIZE (OSVR_CARDBOARD_WIRE_HEADER_SIZE + OSVR_CARDBOARD_WIRE_MAX_PAYLOAD)
+#define TS_FRAMER_INITIAL_SIZE 4096
+
+namespace OSVRCardboard {
+	enum class FrameStatus {
+		Ok,
+		NeedMore,
+		Invalid
+	};
+
+	/// Reassembles frames from a byte stream. Data is received straight into
+	/// the framer's buffer (prepare/commit) and complete frames come back as
+	/// views into that buffer, valid until the next call to prepare().
+	///
+	/// A newline delimited frame longer than the maximum frame size is
+	/// discarded up to its delimiter and counted in oversized(); a binary frame
+	/// header that doesn't decode means framing is lost and is reported as
+	/// Invalid.
+	class StreamFramer {
+	public:
+		StreamFramer(size_t maxFrameSize = TS_MAX_FRAME_SIZE);
+
+		/// Returns space for at least size more bytes
+		char* prepare(size_t size);
+		void commit(size_t size);
+
+		/// The line excludes its delimiter (and any '\r' before it) and is NUL
+		/// terminated in place, so it can be handed to C string functions.
+		FrameStatus nextLine(std::string_view& line);
+		FrameStatus nextFrame(wire::Header& header, std::string_view& payload);
+
+		size_t buffered() const;
+		uint64_t oversized() const;
+		void clear();
+
+	private:
+		std::vector<char> m_buffer;
+		size_t m_begin = 0;
+		size_t m_end = 0;
+		// Where the search for the next delimiter resumes
+		size_t m_scanned = 0;
+		size_t m_max_frame_size;
+		bool m_discarding = false;
+		uint64_t m_oversized = 0;
+	};
+}
\ No newline at end of file
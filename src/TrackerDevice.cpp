@@ -0,0 +1,124 @@
+#include "TrackerDevice.h"
+#include "je_nourish_cardboard_json.h"
+
+namespace OSVRCardboard {
+
+	TrackerDevice::TrackerDevice(OSVR_PluginRegContext ctx) : mContext(ctx)
+	{
+		m_config = TrackingConfig::fromDescriptor(je_nourish_cardboard_json);
+		m_filters.assign(m_config.sensors, OrientationFilter(m_config.filter));
+		m_predictors.assign(m_config.sensors, PosePredictor(m_config.prediction));
+		m_deliveries.assign(m_config.sensors, SampleDelivery(m_config.delivery));
+		m_sensors.assign(m_config.sensors, SensorState());
+
+		m_server.reset(new TrackingServer(m_config));
+		m_metrics.reset(new MetricsReporter(*m_server, m_config.metrics));
+		m_status.reset(new StatusView(*m_server, m_config));
+
+		OSVR_DeviceInitOptions opts = osvrDeviceCreateInitOptions(ctx);
+
+		osvrDeviceTrackerConfigure(opts, &mTracker);
+
+		/// Create the device token with the options
+		mDev.initAsync(ctx, "GoogleCardboard", opts);
+
+		/// Send JSON descriptor
+		mDev.sendJsonDescriptor(je_nourish_cardboard_json);
+
+		/// Register update callback
+		mDev.registerUpdateCallback(this);
+	}
+
+	TrackerDevice::~TrackerDevice()
+	{
+	}
+
+	OSVR_ReturnCode TrackerDevice::update() {
+		TimestampedQuaternion q;
+		const PredictionConfig& prediction = m_config.prediction;
+		OSVR_TimeValue now;
+		osvrTimeValueGetNow(&now);
+
+		for (int sensor = 0; sensor < m_server->sensorCount(); sensor++) {
+			bool changed = sensorChanged(sensor);
+			size_t count = m_server->drain(m_samples, sensor);
+			if (changed) {
+				// Anything the last phone left queued comes first, and the new
+				// phone's clock may be behind it
+				size_t first = 0;
+				for (size_t i = 1; i < count; i++) {
+					if (toMicroseconds(m_samples[i].timestamp) < toMicroseconds(m_samples[i - 1].timestamp)) {
+						first = i;
+					}
+				}
+				m_samples.erase(m_samples.begin(), m_samples.begin() + first);
+				count -= first;
+			}
+			count = m_filters[sensor].process(m_samples.data(), count);
+
+			// The predictor wants every sample, whatever the delivery policy. It
+			// also supplies the angular velocity.
+			PosePredictor& predictor = m_predictors[sensor];
+			if (prediction.enabled || m_config.angularVelocity) {
+				for (size_t i = 0; i < count; i++) {
+					predictor.addSample(m_samples[i]);
+				}
+			}
+
+			if (prediction.enabled) {
+				// One pose per update, extrapolated to when it's likely to be
+				// displayed, while there's a phone to extrapolate from
+				OSVR_TimeValue target = fromMicroseconds(toMicroseconds(now) + (int64_t)(prediction.lookahead * 1e6));
+				if (m_sensors[sensor].connected && predictor.predict(target, q)) {
+					osvrDeviceTrackerSendOrientationTimestamped(mDev, mTracker, &q.quaternion, sensor, &q.timestamp);
+				}
+			}
+			else {
+				m_delivered.resize(count > 0 ? count : 1);
+				size_t delivered = m_deliveries[sensor].select(m_samples.data(), count, now, m_delivered.data());
+				for (size_t i = 0; i < delivered; i++) {
+					osvrDeviceTrackerSendOrientationTimestamped(mDev, mTracker, &m_delivered[i].quaternion, sensor, &m_delivered[i].timestamp);
+				}
+			}
+
+			if (m_config.angularVelocity && count > 0) {
+				sendAngularVelocity(sensor, m_samples[count - 1]);
+			}
+		}
+
+		return OSVR_RETURN_SUCCESS;
+	}
+
+	// Starts the sensor's filter, predictor and delivery over when its phone
+	// connects, disconnects or changes viewer, so nothing carries over from
+	// the last connection's motion or clock
+	bool TrackerDevice::sensorChanged(int sensor)
+	{
+		SensorState current;
+		current.connection = m_server->connectionGeneration(sensor);
+		current.connected = m_server->connected(sensor);
+		current.config = m_server->configGeneration(sensor);
+
+		SensorState& last = m_sensors[sensor];
+		if (current.connected == last.connected && current.connection == last.connection && current.config == last.config) {
+			return false;
+		}
+		last = current;
+		m_filters[sensor].reset();
+		m_predictors[sensor].reset();
+		m_deliveries[sensor].reset();
+		return true;
+	}
+
+	void TrackerDevice::sendAngularVelocity(int sensor, const TimestampedQuaternion& newest)
+	{
+		// The fit is in the phone's frame; OSVR wants the rotation over dt in
+		// the room's, to premultiply the pose with
+		Vec3 velocity = quatRotate(toQuat(newest.quaternion), m_predictors[sensor].angularVelocity());
+
+		OSVR_AngularVelocityState state;
+		state.dt = TS_VELOCITY_DT;
+		state.incrementalRotation = toOsvr(quatExp(Vec3{ velocity.x * state.dt, velocity.y * state.dt, velocity.z * state.dt }));
+		osvrDeviceTrackerSendAngularVelocityTimestamped(mDev, mTracker, &state, sensor, &newest.timestamp);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "TrackingServer.h"
+#include "TrackingConfig.h"
+#include "MetricsReporter.h"
+#include "OrientationFilter.h"
+#include "PosePredictor.h"
+#include "SampleDelivery.h"
+
+#ifdef OSVR_CARDBOARD_HEADLESS
+#include "HeadlessStatus.h"
+#else
+#include "SettingsWindow.h"
+#endif
+
+#include <memory>
+#include <vector>
+
+#include <osvr/PluginKit/PluginKit.h>
+#include <osvr/PluginKit/TrackerInterfaceC.h>
+
+// Seconds. Angular velocity goes to OSVR as the rotation over this long.
+#define TS_VELOCITY_DT 0.01
+
+namespace OSVRCardboard {
+#ifdef OSVR_CARDBOARD_HEADLESS
+	typedef HeadlessStatus StatusView;
+#else
+	typedef SettingsWindow StatusView;
+#endif
+
+	/// The OSVR tracker device: owns the TrackingServer and reports what it
+	/// receives, one tracker sensor per phone. Status goes to the settings
+	/// window, or to the log in a headless build.
+	class TrackerDevice {
+	public:
+		TrackerDevice(OSVR_PluginRegContext ctx);
+		~TrackerDevice();
+
+		OSVR_ReturnCode update();
+	private:
+		// What the sensor's filter, predictor and delivery state was built from
+		struct SensorState {
+			bool connected = false;
+			uint64_t connection = 0;
+			uint64_t config = 0;
+		};
+
+		bool sensorChanged(int sensor);
+		void sendAngularVelocity(int sensor, const TimestampedQuaternion& newest);
+
+		TrackingConfig m_config;
+		// Declared in the order they start, so they stop in reverse
+		std::unique_ptr<TrackingServer> m_server;
+		std::unique_ptr<MetricsReporter> m_metrics;
+		std::unique_ptr<StatusView> m_status;
+
+		osvr::pluginkit::PluginContext mContext;
+		osvr::pluginkit::DeviceToken mDev;
+		OSVR_TrackerDeviceInterface mTracker;
+		// Per tracker sensor
+		std::vector<OrientationFilter> m_filters;
+		std::vector<PosePredictor> m_predictors;
+		std::vector<SampleDelivery> m_deliveries;
+		std::vector<SensorState> m_sensors;
+		std::vector<TimestampedQuaternion> m_samples;
+		std::vector<TimestampedQuaternion> m_delivered;
+	};
+}
\ No newline at end of file
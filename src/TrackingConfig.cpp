@@ -0,0 +1,134 @@
+#include "TrackingConfig.h"
+
+#include <algorithm>
+
+namespace OSVRCardboard {
+
+	TrackingConfig TrackingConfig::fromJson(const Json::Value& tracking)
+	{
+		TrackingConfig config;
+		if (!tracking.isObject()) {
+			return config;
+		}
+
+		const Json::Value& queue = tracking["queue"];
+		if (queue.isObject()) {
+			if (queue["capacity"].isUInt() && queue["capacity"].asUInt() > 0) {
+				config.queue.capacity = queue["capacity"].asUInt();
+			}
+			if (queue["overflow"].asString() == "drop-newest") {
+				config.queue.overflow = OverflowPolicy::DropNewest;
+			}
+		}
+
+		const Json::Value& filter = tracking["filter"];
+		if (filter.isObject()) {
+			config.filter.enabled = filter.get("enabled", config.filter.enabled).asBool();
+			config.filter.minCutoff = std::max(0.001, filter.get("minCutoffHz", config.filter.minCutoff).asDouble());
+			config.filter.beta = std::max(0.0, filter.get("beta", config.filter.beta).asDouble());
+			config.filter.derivativeCutoff = std::max(0.001, filter.get("derivativeCutoffHz", config.filter.derivativeCutoff).asDouble());
+		}
+
+		const Json::Value& prediction = tracking["prediction"];
+		if (prediction.isObject()) {
+			config.prediction.enabled = prediction.get("enabled", config.prediction.enabled).asBool();
+			config.prediction.acceleration = prediction.get("acceleration", config.prediction.acceleration).asBool();
+			config.prediction.lookahead = prediction.get("lookaheadMs", config.prediction.lookahead * 1000).asDouble() / 1000;
+			config.prediction.maxHorizon = prediction.get("maxHorizonMs", config.prediction.maxHorizon * 1000).asDouble() / 1000;
+			config.prediction.window = prediction.get("windowMs", config.prediction.window * 1000).asDouble() / 1000;
+		}
+
+		const Json::Value& clock = tracking["clock"];
+		if (clock.isObject()) {
+			config.clock.translate = clock.get("translate", config.clock.translate).asBool();
+		}
+
+		const Json::Value& batch = tracking["batch"];
+		if (batch.isObject()) {
+			config.batch.maxSamples = std::min(std::max(batch.get("maxSamples", config.batch.maxSamples).asInt(), 1), OSVR_CARDBOARD_BATCH_MAX_SAMPLES);
+			config.batch.maxDelay = std::max(0.0, batch.get("maxDelayMs", config.batch.maxDelay * 1000).asDouble() / 1000);
+			config.batch.bits = batch.get("bits", config.batch.bits).asInt() == 48 ? 48 : 32;
+		}
+
+		const Json::Value& delivery = tracking["delivery"];
+		if (delivery.isObject()) {
+			std::string policy = delivery["policy"].asString();
+			if (policy == "latest") {
+				config.delivery.policy = DeliveryPolicy::Latest;
+			}
+			else if (policy == "resampled") {
+				config.delivery.policy = DeliveryPolicy::Resampled;
+			}
+			config.delivery.resampleDelay = delivery.get("resampleDelayMs", config.delivery.resampleDelay * 1000).asDouble() / 1000;
+		}
+
+		const Json::Value& metrics = tracking["metrics"];
+		if (metrics.isObject()) {
+			config.metrics.interval = metrics.get("intervalMs", config.metrics.interval * 1000).asDouble() / 1000;
+			config.metrics.file = metrics.get("file", config.metrics.file).asString();
+			config.metrics.statsd = metrics.get("statsd", config.metrics.statsd).asString();
+			config.metrics.prefix = metrics.get("prefix", config.metrics.prefix).asString();
+		}
+
+		const Json::Value& session = tracking["session"];
+		if (session.isObject()) {
+			config.session.record = session.get("record", config.session.record).asString();
+			config.session.replay = session.get("replay", config.session.replay).asString();
+			config.session.realtime = session.get("replayRealtime", config.session.realtime).asBool();
+			config.session.loop = session.get("replayLoop", config.session.loop).asBool();
+		}
+
+		const Json::Value& fusion = tracking["fusion"];
+		if (fusion.isObject()) {
+			config.fusion.kp = std::max(0.0f, fusion.get("kp", config.fusion.kp).asFloat());
+			config.fusion.ki = std::max(0.0f, fusion.get("ki", config.fusion.ki).asFloat());
+			config.fusion.magnetometer = fusion.get("magnetometer", config.fusion.magnetometer).asBool();
+		}
+
+		const Json::Value& distortionMesh = tracking["distortionMesh"];
+		if (distortionMesh.isObject()) {
+			config.distortionMesh.density = std::max(0, distortionMesh.get("density", config.distortionMesh.density).asInt());
+			config.distortionMesh.threads = std::max(0, distortionMesh.get("threads", config.distortionMesh.threads).asInt());
+		}
+
+		const Json::Value& inverseDistortion = tracking["inverseDistortion"];
+		if (inverseDistortion.isObject()) {
+			config.inverseDistortion.order = std::max(1, inverseDistortion.get("order", config.inverseDistortion.order).asInt());
+			config.inverseDistortion.samples = std::max(config.inverseDistortion.order + 1,
+				inverseDistortion.get("samples", config.inverseDistortion.samples).asInt());
+		}
+
+		// Where older configs kept the display config path
+		const Json::Value& headless = tracking["headless"];
+		if (headless.isObject()) {
+			config.profiles.displayConfig = headless.get("displayConfig", config.profiles.displayConfig).asString();
+		}
+
+		const Json::Value& profiles = tracking["profiles"];
+		if (profiles.isObject()) {
+			config.profiles.store = profiles.get("store", config.profiles.store).asString();
+			config.profiles.displayConfig = profiles.get("displayConfig", config.profiles.displayConfig).asString();
+		}
+
+		return config;
+	}
+
+	TrackingConfig TrackingConfig::fromDescriptor(const char* descriptor)
+	{
+		Json::Value json;
+		Json::Reader reader;
+
+		if (!reader.parse(descriptor, json) || !json.isObject()) {
+			return TrackingConfig();
+		}
+		TrackingConfig config = fromJson(json["tracking"]);
+
+		config.angularVelocity = json["interfaces"]["tracker"]["angularVelocity"].asBool();
+
+		const Json::Value& count = json["interfaces"]["tracker"]["count"];
+		if (count.isInt()) {
+			config.sensors = std::min(std::max(count.asInt(), 1), TS_MAX_SENSORS);
+		}
+		return config;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "SampleRing.h"
+#include "PosePredictor.h"
+#include "OrientationFilter.h"
+#include "SampleDelivery.h"
+#include "Metrics.h"
+#include "SessionLog.h"
+#include "ProfileStore.h"
+#include "DistortionMesh.h"
+#include "InverseDistortion.h"
+#include "ImuFusion.h"
+#include "WireProtocol.h"
+
+#include <json/json.h>
+
+#define TS_DEFAULT_QUEUE_CAPACITY 256
+// Upper bound on concurrent phones, each reporting as its own tracker sensor
+#define TS_MAX_SENSORS 16
+
+namespace OSVRCardboard {
+	struct QueueConfig {
+		size_t capacity = TS_DEFAULT_QUEUE_CAPACITY;
+		OverflowPolicy overflow = OverflowPolicy::DropOldest;
+	};
+
+	struct ClockConfig {
+		// Move sample timestamps from the phone's clock onto ours
+		bool translate = true;
+	};
+
+	/// Plugin side tuning, read from the "tracking" section of the device
+	/// descriptor. Anything missing keeps its default.
+	struct TrackingConfig {
+		// One per phone that can be connected at once, taken from the tracker
+		// interface count
+		int sensors = 1;
+		// Report angular velocity alongside orientation, when the descriptor's
+		// tracker interface advertises it
+		bool angularVelocity = false;
+		QueueConfig queue;
+		FilterConfig filter;
+		PredictionConfig prediction;
+		ClockConfig clock;
+		// Offered to binary clients that batch their orientations
+		wire::BatchConfig batch;
+		DeliveryConfig delivery;
+		MetricsConfig metrics;
+		SessionConfig session;
+		// For phones that send raw sensor readings instead of orientations
+		FusionConfig fusion;
+		// Used when saving a display config
+		DistortionMeshConfig distortionMesh;
+		InverseDistortionConfig inverseDistortion;
+		ProfileConfig profiles;
+
+		static TrackingConfig fromJson(const Json::Value& tracking);
+		static TrackingConfig fromDescriptor(const char* descriptor);
+	};
+}
\ No newline at end of file
@@ -1,57 +1,181 @@
 #include "TrackingServer.h"
 
+#include "OrientationParser.h"
+
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <cstdio>
+#include <cstring>
 #include <json/json.h>
 
 namespace OSVRCardboard {
 
-	TrackingServer::TrackingServer()
+	TrackingServer::TrackingServer(const TrackingConfig& config)
 	{
-		m_net_thread = new std::thread(TrackingServer::net_thread, std::ref(m_net_thread_data));
+		for (int i = 0; i < config.sensors; i++) {
+			std::unique_ptr<SensorChannel> sensor(new SensorChannel());
+			sensor->quaternions.configure(config.queue.capacity, config.queue.overflow);
+			m_net_thread_data.sensors.push_back(std::move(sensor));
+		}
+		m_net_thread_data.clients.resize(config.sensors);
+		for (int i = 0; i < config.sensors; i++) {
+			m_net_thread_data.clients[i].sensor = i;
+		}
+		m_net_thread_data.translateTimestamps = config.clock.translate;
+		m_net_thread_data.batch = config.batch;
+		m_net_thread_data.session = config.session;
+		m_net_thread_data.fusion.configure(config.sensors, config.fusion);
+		m_net_thread_data.profilePath = config.profiles.store;
+
+		if (config.session.replay.empty()) {
+			m_net_thread = new std::thread(TrackingServer::net_thread, std::ref(m_net_thread_data));
+		}
+		else {
+			m_net_thread = new std::thread(TrackingServer::replay_thread, std::ref(m_net_thread_data));
+		}
 	}
 
-	Viewer TrackingServer::config()
+	int TrackingServer::sensorCount()
 	{
-		std::lock_guard<std::mutex> lock(m_net_thread_data.mutex);
-		return m_net_thread_data.config;
+		return (int)m_net_thread_data.sensors.size();
 	}
 
-	bool TrackingServer::hasQuaternion()
+	int TrackingServer::clientCount()
 	{
-		std::lock_guard<std::mutex> lock(m_net_thread_data.mutex);
-		return !m_net_thread_data.quaternions.empty();
+		return m_net_thread_data.clientCount;
 	}
 
-	TimestampedQuaternion TrackingServer::quaternion()
+	std::shared_ptr<const Viewer> TrackingServer::config(int sensor)
 	{
-		std::lock_guard<std::mutex> lock(m_net_thread_data.mutex);
-		TimestampedQuaternion q = m_net_thread_data.quaternions.front();
-		m_net_thread_data.quaternions.pop();
-		return q;
+		return std::atomic_load(&m_net_thread_data.sensors[sensor]->config);
+	}
+
+	uint64_t TrackingServer::configGeneration(int sensor)
+	{
+		return m_net_thread_data.sensors[sensor]->configGeneration;
+	}
+
+	bool TrackingServer::connected(int sensor)
+	{
+		return m_net_thread_data.sensors[sensor]->connected;
+	}
+
+	uint64_t TrackingServer::connectionGeneration(int sensor)
+	{
+		return m_net_thread_data.sensors[sensor]->connectionGeneration;
+	}
+
+	bool TrackingServer::hasQuaternion(int sensor)
+	{
+		return !m_net_thread_data.sensors[sensor]->quaternions.empty();
+	}
+
+	bool TrackingServer::quaternion(TimestampedQuaternion& q, int sensor)
+	{
+		SensorChannel& channel = *m_net_thread_data.sensors[sensor];
+		if (!channel.quaternions.pop(q)) {
+			return false;
+		}
+		delivered(channel, &q, 1);
+		return true;
+	}
+
+	size_t TrackingServer::drain(std::vector<TimestampedQuaternion>& out, int sensor)
+	{
+		SensorChannel& channel = *m_net_thread_data.sensors[sensor];
+		// Sized to what's queued rather than the whole ring, so an idle tick
+		// touches nothing. Anything pushed in between waits for the next call.
+		out.resize(channel.quaternions.size());
+		out.resize(channel.quaternions.pop(out.data(), out.size()));
+		delivered(channel, out.data(), out.size());
+		return out.size();
+	}
+
+	void TrackingServer::delivered(SensorChannel& channel, const TimestampedQuaternion* samples, size_t count)
+	{
+		if (!count) {
+			return;
+		}
+		OSVR_TimeValue now;
+		osvrTimeValueGetNow(&now);
+		int64_t time = toMicroseconds(now);
+
+		channel.metrics.samplesDelivered.add(count);
+		for (size_t i = 0; i < count; i++) {
+			int64_t age = time - toMicroseconds(samples[i].timestamp);
+			channel.metrics.sampleAge.record(age > 0 ? (uint64_t)age : 0);
+		}
+	}
+
+	uint64_t TrackingServer::droppedQuaternions(int sensor)
+	{
+		return m_net_thread_data.sensors[sensor]->quaternions.dropped();
+	}
+
+	TransportStats TrackingServer::transportStats(int sensor)
+	{
+		const SensorChannel& channel = *m_net_thread_data.sensors[sensor];
+		TransportStats stats;
+		stats.datagrams = channel.datagrams;
+		stats.lost = channel.datagramsLost;
+		stats.reordered = channel.datagramsReordered;
+		return stats;
+	}
+
+	ClockStats TrackingServer::clockStats(int sensor)
+	{
+		return m_net_thread_data.sensors[sensor]->clock.stats();
+	}
+
+	MetricsSnapshot TrackingServer::metrics(int sensor)
+	{
+		const SensorChannel& channel = *m_net_thread_data.sensors[sensor];
+		const PipelineMetrics& metrics = channel.metrics;
+		OSVR_TimeValue now;
+		osvrTimeValueGetNow(&now);
+
+		MetricsSnapshot snapshot;
+		snapshot.time = toMicroseconds(now);
+		snapshot.connected = channel.connected;
+		snapshot.bytesReceived = metrics.bytesReceived.value();
+		snapshot.messagesReceived = metrics.messagesReceived.value();
+		snapshot.samplesParsed = metrics.samplesParsed.value();
+		snapshot.parseFailures = metrics.parseFailures.value();
+		snapshot.samplesQueued = metrics.samplesQueued.value();
+		snapshot.samplesDropped = channel.quaternions.dropped();
+		snapshot.samplesDelivered = metrics.samplesDelivered.value();
+		snapshot.queueDepth = channel.quaternions.size();
+		snapshot.queueHighWater = metrics.queueHighWater.value();
+		snapshot.interArrival = metrics.interArrival.snapshot();
+		snapshot.jitter = metrics.jitter.snapshot();
+		snapshot.sampleAge = metrics.sampleAge.snapshot();
+		return snapshot;
 	}
 
-	bool TrackingServer::configChanged()
+	bool TrackingServer::configChanged(int sensor)
 	{
-		bool ret = m_net_thread_data.configChanged;
-		m_net_thread_data.configChanged = false;
-		return ret;
+		return m_net_thread_data.sensors[sensor]->configChanged.exchange(false);
 	}
 
 	void TrackingServer::disconnect()
 	{
-		std::lock_guard<std::mutex> lock(m_net_thread_data.mutex);
 		m_net_thread_data.disconnect = true;
+		m_net_thread_data.loop.wake();
+	}
+
+	bool TrackingServer::replayFinished()
+	{
+		return m_net_thread_data.replayFinished;
 	}
 
 	void TrackingServer::net_thread(net_thread_data& data)
 	{
 		SET_STATUS(data, false, "Initialising networking");
 
-		WSADATA WsaDat;
-		if (WSAStartup(MAKEWORD(2, 2), &WsaDat) != 0)
+		if (!data.loop.valid())
 		{
 			SET_ERROR(data, "Network initialization failed");
-			WSACleanup();
 			return;
 		}
 
@@ -59,127 +183,908 @@ namespace OSVRCardboard {
 		if (Socket == INVALID_SOCKET)
 		{
 			SET_ERROR(data, "Network initialization failed");
-			WSACleanup();
 			return;
 		}
 
+#ifndef _WIN32
+		int reuse = 1;
+		setsockopt(Socket, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse, sizeof(reuse));
+#endif
+
 		SOCKADDR_IN serverInf;
 		serverInf.sin_family = AF_INET;
 		serverInf.sin_addr.s_addr = INADDR_ANY;
 		serverInf.sin_port = htons(OSVR_CARDBOARD_PORT);
 
-		if (bind(Socket, (SOCKADDR*)(&serverInf), sizeof(serverInf)) == SOCKET_ERROR)
+		if (bind(Socket, (SOCKADDR*)(&serverInf), sizeof(serverInf)) == SOCKET_ERROR ||
+			listen(Socket, (int)data.clients.size()) == SOCKET_ERROR ||
+			!net::setNonBlocking(Socket) ||
+			!data.loop.add(Socket, EventLoop::Readable))
 		{
 			SET_ERROR(data, "Network initialization failed");
-			WSACleanup();
+			closesocket(Socket);
 			return;
 		}
 
-		listen(Socket, 1);
+		// UDP is optional, clients are told whether it's available in the handshake
+		data.udpSocket = openDatagramSocket();
+		if (data.udpSocket != INVALID_SOCKET && !data.loop.add(data.udpSocket, EventLoop::Readable)) {
+			closesocket(data.udpSocket);
+			data.udpSocket = INVALID_SOCKET;
+		}
+
+		if (!data.session.record.empty() && !data.recorder.open(data.session.record)) {
+			std::cout << "Can't record to " << data.session.record << std::endl;
+		}
+
+		// Every sensor gets the viewer it last had before any phone connects
+		if (!data.profilePath.empty()) {
+			if (data.profiles.open(data.profilePath)) {
+				for (int sensor = 0; sensor < (int)data.sensors.size(); sensor++) {
+					const ProfileStore::Profile* profile = data.profiles.lastOnSensor(sensor);
+					if (profile) {
+						restoreProfile(data, sensor, *profile);
+					}
+				}
+			}
+			else {
+				std::cout << "Can't open profile store " << data.profilePath << std::endl;
+			}
+		}
+
+		SET_STATUS(data, false, "Waiting for connection");
+
+		bool listening = true;
+		EventLoop::Event events[TS_MAX_EVENTS];
+
+		while (!data.end) {
+			int count = data.loop.wait(events, TS_MAX_EVENTS, TS_WAIT_TIMEOUT_MS);
+			if (count == 0) {
+				// Quiet, so a good time to get the recording onto disk
+				data.recorder.flush();
+			}
+
+			for (int i = 0; i < count; i++) {
+				if (events[i].socket == Socket) {
+					acceptClient(data, Socket);
+				}
+				else if (events[i].socket == data.udpSocket) {
+					receiveDatagrams(data);
+				}
+				else {
+					ClientConnection& client = *(ClientConnection*)events[i].context;
+					if (!receive(data, client)) {
+						closeClient(data, client);
+					}
+				}
+			}
+			flushFusion(data);
+
+			if (data.disconnect || data.end) {
+				for (ClientConnection& client : data.clients) {
+					if (client.socket != INVALID_SOCKET) {
+						closeClient(data, client);
+					}
+				}
+				data.disconnect = false;
+			}
+
+			// Every sensor taken: stop listening until one frees up
+			bool full = data.clientCount == (int)data.clients.size();
+			if (full && listening) {
+				data.loop.remove(Socket);
+				listening = false;
+			}
+			else if (!full && !listening && !data.end) {
+				data.loop.add(Socket, EventLoop::Readable);
+				listening = true;
+			}
+		}
+
+		if (data.udpSocket != INVALID_SOCKET) {
+			closesocket(data.udpSocket);
+			data.udpSocket = INVALID_SOCKET;
+		}
+		closesocket(Socket);
+		data.recorder.close();
+		data.profiles.close();
+	}
+
+	void TrackingServer::replay_thread(net_thread_data& data)
+	{
+		session::SessionReader reader;
+		if (!reader.open(data.session.replay)) {
+			SET_ERROR(data, "Can't open session log");
+			return;
+		}
+		SET_STATUS(data, true, "Replaying session");
 
-		bool end = false;
 		do {
+			session::Record record;
+			auto start = std::chrono::steady_clock::now();
+			int64_t firstTime = INT64_MIN;
+			int64_t shift = 0;
 
-			SET_STATUS(data, false, "Waiting for connection");
+			while (!data.end && reader.next(record)) {
+				// Recorded times are moved to now, so replayed samples look live
+				if (firstTime == INT64_MIN) {
+					OSVR_TimeValue now;
+					osvrTimeValueGetNow(&now);
+					firstTime = record.time;
+					shift = toMicroseconds(now) - record.time;
+				}
+				if (data.session.realtime) {
+					std::this_thread::sleep_until(start + std::chrono::microseconds(record.time - firstTime));
+				}
+				replayRecord(data, record, shift);
+				flushFusion(data);
+			}
 
-			SOCKET ClientSocket = SOCKET_ERROR;
-			while (ClientSocket == SOCKET_ERROR)
-			{
-				ClientSocket = accept(Socket, NULL, NULL);
+			// Whoever was still connected when the recording stopped leaves now
+			for (int sensor = 0; sensor < (int)data.clients.size(); sensor++) {
+				if (data.sensors[sensor]->connected) {
+					closeClient(data, data.clients[sensor]);
+				}
+			}
+			reader.rewind();
+		} while (data.session.loop && !data.end);
+
+		data.replayFinished = true;
+		SET_STATUS(data, false, "Replay finished");
+	}
+
+	void TrackingServer::replayRecord(net_thread_data& data, const session::Record& record, int64_t shift)
+	{
+		if (record.sensor >= data.clients.size()) {
+			return;
+		}
+		ClientConnection& client = data.clients[record.sensor];
+		SensorChannel& channel = *data.sensors[record.sensor];
+		client.receiveTime = record.time + shift;
+
+		switch (record.type) {
+		case session::Connect:
+			// The session before ended without a Disconnect, a crash perhaps
+			if (channel.connected) {
+				closeClient(data, client);
+			}
+			client = ClientConnection();
+			client.sensor = record.sensor;
+			channel.clock.reset();
+			channel.metrics.lastArrival = INT64_MIN;
+			channel.metrics.lastInterval = -1;
+			data.fusion.reset(record.sensor);
+			data.fusion.setMagnetometer(record.sensor, !std::atomic_load(&channel.config)->hasMagnet());
+			channel.connectionGeneration++;
+			channel.connected = true;
+			data.clientCount++;
+			updateStatus(data);
+			break;
+
+		case session::Disconnect:
+			if (channel.connected) {
+				closeClient(data, client);
+			}
+			break;
+
+		case session::Stream: {
+			char* buffer = client.framer.prepare(record.length);
+			memcpy(buffer, record.data, record.length);
+			client.framer.commit(record.length);
+			channel.metrics.bytesReceived.add(record.length);
+			if (!processFrames(data, client)) {
+				closeClient(data, client);
 			}
+			break;
+		}
+
+		case session::Datagram:
+			// Routed by sensor, the session ids were only valid on the day
+			if (record.length >= OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE) {
+				processDatagramFrames(data, client, record.data, record.length);
+			}
+			break;
+
+		default:
+			// Samples are the recorded output, not input
+			break;
+		}
+	}
+
+	bool TrackingServer::acceptClient(net_thread_data& data, SOCKET listenSocket)
+	{
+		SOCKET ClientSocket = accept(listenSocket, NULL, NULL);
+		if (ClientSocket == INVALID_SOCKET) return false;
+
+		// Lowest free sensor, so the first phone to connect is always the head
+		int sensor = 0;
+		while (sensor < (int)data.clients.size() && data.clients[sensor].socket != INVALID_SOCKET) {
+			sensor++;
+		}
+		// Clock sync replies are tiny and timed, Nagle would hold them back
+		if (sensor == (int)data.clients.size() ||
+			!net::setNonBlocking(ClientSocket) ||
+			!net::setNoDelay(ClientSocket))
+		{
+			net::closeSocket(ClientSocket);
+			return false;
+		}
+
+		ClientConnection& client = data.clients[sensor];
+		client = ClientConnection();
+		client.socket = ClientSocket;
+		client.sensor = sensor;
+		if (!data.loop.add(ClientSocket, EventLoop::Readable, &client)) {
+			net::closeSocket(ClientSocket);
+			client = ClientConnection();
+			return false;
+		}
+
+		SensorChannel& channel = *data.sensors[sensor];
+		channel.clock.reset();
+		channel.metrics.lastArrival = INT64_MIN;
+		channel.metrics.lastInterval = -1;
+		data.fusion.reset(sensor);
+		data.fusion.setMagnetometer(sensor, !std::atomic_load(&channel.config)->hasMagnet());
+		channel.connectionGeneration++;
+		channel.connected = true;
+		data.clientCount++;
+		updateStatus(data);
 
+		OSVR_TimeValue now;
+		osvrTimeValueGetNow(&now);
+		data.recorder.write(session::Connect, sensor, toMicroseconds(now));
+		return true;
+	}
+
+	void TrackingServer::closeClient(net_thread_data& data, ClientConnection& client)
+	{
+		OSVR_TimeValue now;
+		osvrTimeValueGetNow(&now);
+		data.recorder.write(session::Disconnect, client.sensor, toMicroseconds(now));
+		data.recorder.flush();
+
+		// Replayed clients have no socket
+		if (client.socket != INVALID_SOCKET) {
+			data.loop.remove(client.socket);
+			net::closeSocket(client.socket);
+		}
+		data.sensors[client.sensor]->connected = false;
+		int sensor = client.sensor;
+		// Anything not yet fused belonged to this connection
+		data.fusion.reset(sensor);
+		client = ClientConnection();
+		client.sensor = sensor;
+		data.clientCount--;
+		updateStatus(data);
+	}
+
+	void TrackingServer::updateStatus(net_thread_data& data)
+	{
+		if (data.end) {
+			return;
+		}
+		if (data.clientCount == 0) {
+			SET_STATUS(data, false, "Waiting for connection");
+		}
+		else if (data.clientCount == 1) {
 			SET_STATUS(data, true, "Client connected");
+		}
+		else {
+			SET_STATUS(data, true, "Multiple clients connected");
+		}
+	}
 
-			int received = 0;
-			char report[TS_BUFFER_SIZE];
-			char sendBuffer[TS_BUFFER_SIZE];
-			do {
-				if (data.end || data.disconnect) {
-					break;
-				}
-
-				received = recv(ClientSocket, (char*)report, TS_BUFFER_SIZE - 1, 0);
-				if (received == SOCKET_ERROR) break;
-
-				report[received] = 0;
-				
-				double x, y, z, w;
-				OSVR_TimeValue_Seconds s;
-				OSVR_TimeValue_Microseconds m;
-
-				char* context;
-				char* lineptr = strtok_s(report, OSVR_CARDBOARD_DELIMITER, &context);
-				while (lineptr) {
-					//printf("%s\n", lineptr);
-					// Orientation report
-					if (6 == sscanf_s(lineptr, "{\"x\":%lf,\"y\":%lf,\"z\":%lf,\"w\":%lf,\"s\":%lld,\"m\":%ld}", &x, &y, &z, &w, &s, &m)) {
-						TimestampedQuaternion q;
-						osvrQuatSetX(&q.quaternion, x);
-						osvrQuatSetY(&q.quaternion, y);
-						osvrQuatSetZ(&q.quaternion, z);
-						osvrQuatSetW(&q.quaternion, w);
-						q.timestamp.seconds = s;
-						q.timestamp.microseconds = m;
-						data.mutex.lock();
-						data.quaternions.push(q);
-						data.mutex.unlock();
+	SOCKET TrackingServer::openDatagramSocket()
+	{
+		SOCKET udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (udpSocket == INVALID_SOCKET) {
+			return INVALID_SOCKET;
+		}
+
+		SOCKADDR_IN serverInf;
+		serverInf.sin_family = AF_INET;
+		serverInf.sin_addr.s_addr = INADDR_ANY;
+		serverInf.sin_port = htons(OSVR_CARDBOARD_PORT);
+
+		if (bind(udpSocket, (SOCKADDR*)(&serverInf), sizeof(serverInf)) == SOCKET_ERROR ||
+			!net::setNonBlocking(udpSocket))
+		{
+			closesocket(udpSocket);
+			return INVALID_SOCKET;
+		}
+
+#ifdef __linux__
+		// Kernel receive timestamps, best effort
+		int timestamps = 1;
+		setsockopt(udpSocket, SOL_SOCKET, SO_TIMESTAMPNS, (char*)&timestamps, sizeof(timestamps));
+#endif
+		return udpSocket;
+	}
+
+	void TrackingServer::receiveDatagrams(net_thread_data& data)
+	{
+		char buffers[TS_DATAGRAM_BATCH][TS_DATAGRAM_SIZE];
+		SOCKADDR_IN senders[TS_DATAGRAM_BATCH];
+
+#ifdef __linux__
+		mmsghdr messages[TS_DATAGRAM_BATCH];
+		iovec iovecs[TS_DATAGRAM_BATCH];
+		char controls[TS_DATAGRAM_BATCH][CMSG_SPACE(sizeof(timespec))];
+		for (int i = 0; i < TS_DATAGRAM_BATCH; i++) {
+			iovecs[i].iov_base = buffers[i];
+			iovecs[i].iov_len = TS_DATAGRAM_SIZE;
+			messages[i] = mmsghdr();
+			messages[i].msg_hdr.msg_iov = &iovecs[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		while (true) {
+			for (int i = 0; i < TS_DATAGRAM_BATCH; i++) {
+				messages[i].msg_hdr.msg_control = controls[i];
+				messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+				messages[i].msg_hdr.msg_name = &senders[i];
+				messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+			}
+			int count = recvmmsg(data.udpSocket, messages, TS_DATAGRAM_BATCH, MSG_DONTWAIT, nullptr);
+			if (count <= 0) break;
+
+			OSVR_TimeValue now;
+			osvrTimeValueGetNow(&now);
+			for (int i = 0; i < count; i++) {
+				if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+					continue;
+				}
+				// The kernel's receive time if SO_TIMESTAMPNS is on. That's the
+				// realtime clock, which is what OSVR's clock is on Linux.
+				int64_t receiveTime = toMicroseconds(now);
+				for (cmsghdr* message = CMSG_FIRSTHDR(&messages[i].msg_hdr); message; message = CMSG_NXTHDR(&messages[i].msg_hdr, message)) {
+					if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMPNS) {
+						timespec stamp;
+						memcpy(&stamp, CMSG_DATA(message), sizeof(stamp));
+						receiveTime = (int64_t)stamp.tv_sec * 1000000 + stamp.tv_nsec / 1000;
 					}
-					// Clock synchronistion
-					else if (2 == sscanf_s(lineptr, "{\"s\":%lld,\"m\":%ld}", &s, &m)) {
-						OSVR_TimeValue timeValue;
-						osvrTimeValueGetNow(&timeValue);
-						int sent = sprintf_s(sendBuffer, TS_BUFFER_SIZE, "{\"s\":%lld,\"m\":%ld,\"ss\":%lld,\"sm\":%ld}\n", s, m, timeValue.seconds, timeValue.microseconds);
-						send(ClientSocket, sendBuffer, sent, 0);
+				}
+				processDatagram(data, buffers[i], messages[i].msg_len, senders[i], receiveTime);
+			}
+			if (count < TS_DATAGRAM_BATCH) break;
+		}
+#else
+		while (true) {
+			socklen_t senderLength = sizeof(senders[0]);
+			int received = recvfrom(data.udpSocket, buffers[0], TS_DATAGRAM_SIZE, 0, (SOCKADDR*)&senders[0], &senderLength);
+			if (received == SOCKET_ERROR) {
+				// Oversized datagrams and ICMP errors only affect that one datagram
+				if (net::wouldBlock()) break;
+				continue;
+			}
+			OSVR_TimeValue now;
+			osvrTimeValueGetNow(&now);
+			processDatagram(data, buffers[0], received, senders[0], toMicroseconds(now));
+		}
+#endif
+
+		for (const ClientConnection& client : data.clients) {
+			if (client.udp) {
+				SensorChannel& channel = *data.sensors[client.sensor];
+				channel.datagramsLost = client.sequence.lost();
+				channel.datagramsReordered = client.sequence.reordered();
+			}
+		}
+	}
+
+	void TrackingServer::processDatagram(net_thread_data& data, const char* datagram, size_t length, const SOCKADDR_IN& sender, int64_t receiveTime)
+	{
+		if (length < OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE) {
+			return;
+		}
+
+		// Sessions are unique among clients, so a datagram can only belong to one
+		uint32_t sessionId = wire::getU32(datagram);
+		for (ClientConnection& client : data.clients) {
+			if (client.udp && client.session == sessionId) {
+				// The id alone is only 32 bits on the wire in the clear. Whoever
+				// sends the first datagram that decodes owns the session from
+				// then on, and anything else carrying the id is ignored.
+				if (!client.peerPinned) {
+					wire::Header header;
+					if (wire::decodeHeader(datagram + OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE,
+						length - OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE, header) != wire::DecodeStatus::Ok)
+					{
+						return;
 					}
-					// Config object
-					else {
-						Json::Value configJson;
-						Json::Reader reader;
-						bool parsed;
-
-						parsed = reader.parse(report, configJson);
-
-						if (parsed && configJson.isObject() && configJson.isMember("viewerParams")) {
-								try {
-									data.mutex.lock();
-									data.config.parseFromJson(configJson);
-									data.configChanged = true;
-									data.mutex.unlock();
-								}
-								catch (const std::bad_alloc& e) {
-									std::cout << "Bad config: " << report << std::endl;
-								}
-						}
+					client.peer = sender;
+					client.peerPinned = true;
+				}
+				else if (client.peer.sin_addr.s_addr != sender.sin_addr.s_addr || client.peer.sin_port != sender.sin_port) {
+					return;
+				}
+				client.receiveTime = receiveTime;
+				data.recorder.write(session::Datagram, client.sensor, receiveTime, datagram, length);
+				processDatagramFrames(data, client, datagram, length);
+				return;
+			}
+		}
+	}
+
+	void TrackingServer::processDatagramFrames(net_thread_data& data, ClientConnection& client, const char* datagram, size_t length)
+	{
+		SensorChannel& channel = *data.sensors[client.sensor];
+		channel.datagrams++;
+		channel.metrics.bytesReceived.add(length);
+
+		size_t offset = OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE;
+		while (offset < length) {
+			wire::Header header;
+			const char* frame = datagram + offset;
+			if (wire::decodeHeader(frame, length - offset, header) != wire::DecodeStatus::Ok) {
+				channel.metrics.parseFailures.add();
+				return;
+			}
+			offset += OSVR_CARDBOARD_WIRE_HEADER_SIZE + header.length;
+			channel.metrics.messagesReceived.add();
+
+			const char* payload = frame + OSVR_CARDBOARD_WIRE_HEADER_SIZE;
+			TimestampedQuaternion q;
+			ImuSample sample;
+			int64_t timestamp;
+			if (header.type == wire::OrientationBatch) {
+				wire::BatchReader batch;
+				if (!batch.open(payload, header.length)) {
+					channel.metrics.parseFailures.add();
+					continue;
+				}
+				channel.metrics.samplesParsed.add(batch.count());
+				if (!client.sequence.accept(header.sequence)) {
+					continue;
+				}
+				// Overlapping a batch already delivered only drops the overlap
+				while (batch.next(q)) {
+					timestamp = toMicroseconds(q.timestamp);
+					if (timestamp >= client.newestDatagramSample) {
+						client.newestDatagramSample = timestamp;
+						deliver(data, client, q);
 					}
-					lineptr = strtok_s(NULL, OSVR_CARDBOARD_DELIMITER, &context);
 				}
-				
-			} while (received != 0);
+				continue;
+			}
+			else if (header.type == wire::Orientation) {
+				if (!wire::decodeOrientation(payload, header.length, q)) {
+					channel.metrics.parseFailures.add();
+					continue;
+				}
+				timestamp = toMicroseconds(q.timestamp);
+			}
+			else if (header.type == wire::RawImu) {
+				if (!wire::decodeRawImu(payload, header.length, sample)) {
+					channel.metrics.parseFailures.add();
+					continue;
+				}
+				timestamp = sample.timestamp;
+			}
+			else {
+				continue;
+			}
+			channel.metrics.samplesParsed.add();
+			if (!client.sequence.accept(header.sequence)) {
+				continue;
+			}
+
+			// In sequence but older than something already delivered is still stale
+			if (timestamp < client.newestDatagramSample) {
+				continue;
+			}
+			client.newestDatagramSample = timestamp;
+			if (header.type == wire::Orientation) {
+				deliver(data, client, q);
+			}
+			else {
+				data.fusion.add(client.sensor, sample, client.receiveTime);
+			}
+		}
+	}
+
+	bool TrackingServer::receive(net_thread_data& data, ClientConnection& client)
+	{
+		// Drain everything the socket has buffered; false once the peer is gone
+		while (true) {
+			char* buffer = client.framer.prepare(TS_BUFFER_SIZE);
+			int received = recv(client.socket, buffer, TS_BUFFER_SIZE, 0);
+			if (received == 0) return false;
+			if (received == SOCKET_ERROR) return net::wouldBlock();
+
+			OSVR_TimeValue now;
+			osvrTimeValueGetNow(&now);
+			client.receiveTime = toMicroseconds(now);
+			data.recorder.write(session::Stream, client.sensor, client.receiveTime, buffer, received);
+
+			client.framer.commit(received);
+			data.sensors[client.sensor]->metrics.bytesReceived.add(received);
+			if (!processFrames(data, client)) return false;
+		}
+	}
+
+	void TrackingServer::processLine(net_thread_data& data, ClientConnection& client, std::string_view line)
+	{
+		SensorChannel& channel = *data.sensors[client.sensor];
+		ParsedLine message = parseLine(line);
+
+		switch (message.type) {
+		// Orientation report
+		case LineType::Orientation:
+			channel.metrics.samplesParsed.add();
+			deliver(data, client, message.sample);
+			break;
+
+		// Clock synchronistion
+		case LineType::ClockSync: {
+			char sendBuffer[TS_BUFFER_SIZE];
+			OSVR_TimeValue timeValue = fromMicroseconds(client.receiveTime);
+			channel.clock.addOneWay(toMicroseconds(message.clientTime), toMicroseconds(timeValue));
+			int sent = snprintf(sendBuffer, TS_BUFFER_SIZE, "{\"s\":%lld,\"m\":%ld,\"ss\":%lld,\"sm\":%ld}\n",
+				(long long)message.clientTime.seconds, (long)message.clientTime.microseconds,
+				(long long)timeValue.seconds, (long)timeValue.microseconds);
+			net::send(client.socket, sendBuffer, sent);
+			break;
+		}
+
+		case LineType::ClockSyncResult: {
+			int64_t serverTime = toMicroseconds(message.serverTime);
+			channel.clock.addExchange(toMicroseconds(message.clientTime), serverTime, serverTime, toMicroseconds(message.clientReceiveTime));
+			break;
+		}
+
+		// Config object or protocol handshake
+		case LineType::Json: {
+			Json::Value configJson;
+			Json::Reader reader;
+			bool parsed;
+
+			parsed = reader.parse(line.data(), line.data() + line.size(), configJson);
+
+			if (parsed && configJson.isObject() && configJson.isMember("protocol")) {
+				handshake(data, client, configJson);
+			}
+			else if (parsed && configJson.isObject() && configJson.isMember("viewerParams")) {
+				applyConfig(data, client, configJson);
+			}
+			else if (!parsed) {
+				channel.metrics.parseFailures.add();
+			}
+			break;
+		}
+
+		case LineType::Invalid:
+			channel.metrics.parseFailures.add();
+			break;
+		}
+	}
+
+	void TrackingServer::handshake(net_thread_data& data, ClientConnection& client, const Json::Value& hello)
+	{
+		Json::Value reply;
+		Json::FastWriter writer;
+
+		// A phone that names itself gets its last viewer back now, rather than
+		// whenever it gets round to sending it
+		if (hello["deviceName"].isString()) {
+			std::string deviceName = hello["deviceName"].asString();
+			const ProfileStore::Profile* profile = data.profiles.lastForDevice(deviceName);
+			std::shared_ptr<const Viewer> current = std::atomic_load(&data.sensors[client.sensor]->config);
+			if (profile && (current->name() != deviceName ||
+				ProfileStore::hashViewerParams(current->viewerParams()) != profile->viewerHash))
+			{
+				restoreProfile(data, client.sensor, *profile);
+			}
+		}
+
+		// Anything malformed gets the line protocol; asString() and friends
+		// throw on the wrong type
+		const Json::Value& protocol = hello["protocol"];
+		const Json::Value& version = hello["version"];
+		const Json::Value& transport = hello["transport"];
+		const Json::Value& batching = hello["batch"];
+		if (protocol.isString() && protocol.asString() == "binary" &&
+			version.isInt() && version.asInt() == OSVR_CARDBOARD_WIRE_VERSION)
+		{
+			reply["protocol"] = "binary";
+			reply["version"] = OSVR_CARDBOARD_WIRE_VERSION;
+
+			if (transport.isString() && transport.asString() == "udp" && data.udpSocket != INVALID_SOCKET) {
+				client.udp = true;
+				// Drawn fresh each time so one session's id says nothing about the
+				// next, and never one a connected client already has
+				bool taken;
+				do {
+					client.session = data.sessionIds();
+					taken = false;
+					for (const ClientConnection& other : data.clients) {
+						taken = taken || (&other != &client && other.udp && other.session == client.session);
+					}
+				} while (taken);
+				client.peerPinned = false;
+				client.sequence.reset();
+				client.newestDatagramSample = INT64_MIN;
+
+				reply["transport"] = "udp";
+				reply["port"] = OSVR_CARDBOARD_PORT;
+				reply["session"] = client.session;
+			}
+			else {
+				reply["transport"] = "tcp";
+			}
+
+			if (batching.isBool() && batching.asBool()) {
+				Json::Value batch;
+				int maxSamples = data.batch.maxSamples;
+				if (client.udp) {
+					// A frame has to fit in one datagram
+					size_t room = TS_DATAGRAM_SIZE - OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE - OSVR_CARDBOARD_WIRE_HEADER_SIZE - wire::OrientationBatchHeaderSize;
+					maxSamples = std::min(maxSamples, (int)(room / (2 + data.batch.bits / 8)));
+				}
+				batch["maxSamples"] = maxSamples;
+				batch["maxDelayMs"] = data.batch.maxDelay * 1000;
+				batch["bits"] = data.batch.bits;
+				reply["batch"] = batch;
+			}
+		}
+		else {
+			reply["protocol"] = "json";
+		}
+
+		// FastWriter terminates with a newline, which is our line delimiter
+		std::string message = writer.write(reply);
+		net::send(client.socket, message.c_str(), (int)message.length());
+
+		if (reply["protocol"].asString() == "binary") {
+			client.mode = WireMode::Binary;
+		}
+	}
+
+	bool TrackingServer::processFrames(net_thread_data& data, ClientConnection& client)
+	{
+		PipelineMetrics& metrics = data.sensors[client.sensor]->metrics;
+
+		// The mode can change part way through, after a handshake line
+		while (true) {
+			FrameStatus status;
+
+			if (client.mode == WireMode::Json) {
+				std::string_view line;
+				status = client.framer.nextLine(line);
+				if (status == FrameStatus::Ok) {
+					processLine(data, client, line);
+				}
+			}
+			else {
+				wire::Header header;
+				std::string_view payload;
+				status = client.framer.nextFrame(header, payload);
+				if (status == FrameStatus::Ok) {
+					processFrame(data, client, header, payload);
+				}
+			}
+
+			if (status == FrameStatus::NeedMore) return true;
+			// Framing is lost for good, the only recovery is a new connection
+			if (status == FrameStatus::Invalid) {
+				metrics.parseFailures.add();
+				return false;
+			}
+			metrics.messagesReceived.add();
+		}
+	}
+
+	void TrackingServer::processFrame(net_thread_data& data, ClientConnection& client, const wire::Header& header, std::string_view payload)
+	{
+		SensorChannel& channel = *data.sensors[client.sensor];
+		switch (header.type) {
+		case wire::Orientation: {
+			TimestampedQuaternion q;
+			if (wire::decodeOrientation(payload.data(), payload.size(), q)) {
+				channel.metrics.samplesParsed.add();
+				deliver(data, client, q);
+			}
+			else {
+				channel.metrics.parseFailures.add();
+			}
+			break;
+		}
+		case wire::OrientationBatch: {
+			wire::BatchReader batch;
+			TimestampedQuaternion q;
+			if (batch.open(payload.data(), payload.size())) {
+				channel.metrics.samplesParsed.add(batch.count());
+				while (batch.next(q)) {
+					deliver(data, client, q);
+				}
+			}
+			else {
+				channel.metrics.parseFailures.add();
+			}
+			break;
+		}
+		case wire::RawImu: {
+			ImuSample sample;
+			if (wire::decodeRawImu(payload.data(), payload.size(), sample)) {
+				channel.metrics.samplesParsed.add();
+				data.fusion.add(client.sensor, sample, client.receiveTime);
+			}
+			else {
+				channel.metrics.parseFailures.add();
+			}
+			break;
+		}
+		case wire::ClockSyncRequest: {
+			int64_t clientTime;
+			if (wire::decodeClockSyncRequest(payload.data(), payload.size(), clientTime)) {
+				OSVR_TimeValue timeValue = fromMicroseconds(client.receiveTime);
+				channel.clock.addOneWay(clientTime, toMicroseconds(timeValue));
 
-			SET_STATUS(data, true, "Client disconnected");
+				char sendBuffer[OSVR_CARDBOARD_WIRE_HEADER_SIZE + wire::ClockSyncReplyPayloadSize];
+				size_t length = wire::encodeClockSyncReply(sendBuffer, client.sendSequence++, clientTime, toMicroseconds(timeValue));
+				net::send(client.socket, sendBuffer, (int)length);
+			}
+			break;
+		}
+		case wire::ClockSyncResult: {
+			int64_t clientSend, serverTime, clientReceive;
+			if (wire::decodeClockSyncResult(payload.data(), payload.size(), clientSend, serverTime, clientReceive)) {
+				channel.clock.addExchange(clientSend, serverTime, serverTime, clientReceive);
+			}
+			break;
+		}
+		case wire::Config: {
+			Json::Value configJson;
+			Json::Reader reader;
+			if (reader.parse(payload.data(), payload.data() + payload.size(), configJson) &&
+				configJson.isObject() && configJson.isMember("viewerParams"))
+			{
+				applyConfig(data, client, configJson);
+			}
+			break;
+		}
+		default:
+			// Unknown types are skipped so newer clients can talk to older servers
+			break;
+		}
+	}
 
-			shutdown(ClientSocket, SB_BOTH);
-			closesocket(ClientSocket);
-			data.disconnect = false;
+	void TrackingServer::deliver(net_thread_data& data, ClientConnection& client, TimestampedQuaternion q)
+	{
+		SensorChannel& channel = *data.sensors[client.sensor];
+		PipelineMetrics& metrics = channel.metrics;
+		int64_t arrival = client.receiveTime;
+		channel.clock.addOneWay(toMicroseconds(q.timestamp), arrival);
 
-		} while (!data.end);
+		if (data.translateTimestamps) {
+			q.timestamp = channel.clock.toServer(q.timestamp);
+		}
+		channel.quaternions.push(q);
+		data.recorder.writeSample(client.sensor, arrival, q);
 
-		WSACleanup();
+		metrics.samplesQueued.add();
+		metrics.queueHighWater.observe(channel.quaternions.size());
+		// Every sample from one receive has its arrival time, and only the
+		// first of them starts a new interval
+		if (arrival != metrics.lastArrival) {
+			if (metrics.lastArrival != INT64_MIN && arrival > metrics.lastArrival) {
+				int64_t interval = arrival - metrics.lastArrival;
+				metrics.interArrival.record((uint64_t)interval);
+				if (metrics.lastInterval >= 0) {
+					metrics.jitter.record((uint64_t)(interval > metrics.lastInterval ? interval - metrics.lastInterval : metrics.lastInterval - interval));
+				}
+				metrics.lastInterval = interval;
+			}
+			metrics.lastArrival = arrival;
+		}
+	}
+
+	void TrackingServer::flushFusion(net_thread_data& data)
+	{
+		if (!data.fusion.pending()) {
+			return;
+		}
+		data.fused.clear();
+		data.fusion.process(data.fused);
+		for (const FusedSample& fused : data.fused) {
+			ClientConnection& client = data.clients[fused.lane];
+			client.receiveTime = fused.receiveTime;
+			deliver(data, client, fused.sample);
+		}
+	}
+
+	void TrackingServer::applyConfig(net_thread_data& data, ClientConnection& client, const Json::Value& configJson)
+	{
+		// Decoded before anyone can see it, then swapped in whole
+		std::shared_ptr<Viewer> viewer = std::make_shared<Viewer>();
+		try {
+			viewer->parseFromJson(configJson);
+		}
+		catch (const std::bad_alloc&) {
+			std::cout << "Bad config: " << configJson.toStyledString() << std::endl;
+			return;
+		}
+		// A field of the wrong type
+		catch (const Json::Exception&) {
+			std::cout << "Bad config: " << configJson.toStyledString() << std::endl;
+			return;
+		}
+		publishConfig(data, client.sensor, viewer);
+
+		if (data.profiles.isOpen()) {
+			Json::FastWriter writer;
+			std::string config = writer.write(configJson);
+			// Without FastWriter's newline
+			config.pop_back();
+			if (!data.profiles.put(client.sensor, viewer->name(), viewer->viewerParams(), config)) {
+				std::cout << "Can't write profile store " << data.profilePath << std::endl;
+			}
+		}
+	}
+
+	void TrackingServer::restoreProfile(net_thread_data& data, int sensor, const ProfileStore::Profile& profile)
+	{
+		Json::Value configJson;
+		Json::Reader reader;
+		std::shared_ptr<Viewer> viewer = std::make_shared<Viewer>();
+		try {
+			if (!reader.parse(profile.config.data(), profile.config.data() + profile.config.size(), configJson)) {
+				return;
+			}
+			viewer->parseFromJson(configJson);
+		}
+		catch (const std::bad_alloc&) {
+			// Stored by an older build that understood it, perhaps
+			return;
+		}
+		catch (const Json::Exception&) {
+			// Or edited by hand
+			return;
+		}
+		publishConfig(data, sensor, viewer);
+	}
+
+	void TrackingServer::publishConfig(net_thread_data& data, int sensor, std::shared_ptr<const Viewer> viewer)
+	{
+		SensorChannel& channel = *data.sensors[sensor];
+		// A magnet in the viewer would drag the heading around
+		data.fusion.setMagnetometer(sensor, !viewer->hasMagnet());
+		std::atomic_store(&channel.config, std::move(viewer));
+		channel.configGeneration++;
+		channel.configChanged = true;
+
+		std::lock_guard<std::mutex> lock(data.mutex);
+		changed(data);
 	}
 
 	TrackingServer::~TrackingServer()
 	{
 		m_net_thread_data.end = true;
+		m_net_thread_data.loop.wake();
 		m_net_thread->join();
 	}
 
 
+	void TrackingServer::setChangeListener(std::function<void()> listener)
+	{
+		std::lock_guard<std::mutex> lock(m_net_thread_data.mutex);
+		m_net_thread_data.listener = std::move(listener);
+	}
+
+	void TrackingServer::changed(net_thread_data& data)
+	{
+		if (data.listener) {
+			data.listener();
+		}
+	}
+
 	bool TrackingServer::hasError()
 	{
 		return m_net_thread_data.error;
 	}
 
-	char* TrackingServer::getError()
+	const char* TrackingServer::getError()
 	{
 		return m_net_thread_data.errorMessage;
 	}
@@ -189,7 +1094,7 @@ namespace OSVRCardboard {
 		return m_net_thread_data.ready;
 	}
 
-	char* TrackingServer::getStatus()
+	const char* TrackingServer::getStatus()
 	{
 		return m_net_thread_data.statusMessage;
 	}
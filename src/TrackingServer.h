@@ -1,68 +1,208 @@
 #pragma once
 
-#define _WINSOCKAPI_
-
-#include <windows.h>
-#include <winsock2.h>
+#include "Socket.h"
+#include "EventLoop.h"
 
 #include <thread>
 #include <mutex>
-#include <queue>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <random>
 
 #include "Viewer.h"
-#include "osvr/Util/QuaternionC.h"
-#include "osvr/Util/TimeValueC.h"
-
-#pragma comment(lib,"ws2_32.lib")
+#include "SampleRing.h"
+#include "TrackingConfig.h"
+#include "TrackingTypes.h"
+#include "WireProtocol.h"
+#include "SequenceTracker.h"
+#include "StreamFramer.h"
+#include "ClockEstimator.h"
+#include "Metrics.h"
+#include "SessionLog.h"
+#include "ImuFusion.h"
+#include "ProfileStore.h"
 
 #define TS_BUFFER_SIZE 1025
+// Every client at once, plus the listening and UDP sockets
+#define TS_MAX_EVENTS (TS_MAX_SENSORS + 2)
+// Upper bound on how long the network thread sleeps without a wake-up
+#define TS_WAIT_TIMEOUT_MS 1000
+#define TS_DATAGRAM_BATCH 32
+#define TS_DATAGRAM_SIZE 1500
 #define OSVR_CARDBOARD_PORT 5555
-#define OSVR_CARDBOARD_DELIMITER "\n"
 
-#define SET_STATUS(data, status, message) (data).mutex.lock(); (data).ready = (status); (data).statusMessage = (message); (data).mutex.unlock();
-#define SET_ERROR(data, message) (data).mutex.lock(); (data).ready = false; (data).error = true; (data).statusMessage = (data).errorMessage = (message); (data).mutex.unlock();
+#define SET_STATUS(data, status, message) (data).mutex.lock(); (data).ready = (status); (data).statusMessage = (message); TrackingServer::changed(data); (data).mutex.unlock();
+#define SET_ERROR(data, message) (data).mutex.lock(); (data).ready = false; (data).error = true; (data).statusMessage = (data).errorMessage = (message); TrackingServer::changed(data); (data).mutex.unlock();
 
 namespace OSVRCardboard {
-	struct TimestampedQuaternion {
-		OSVR_Quaternion quaternion;
-		OSVR_TimeValue timestamp;
+	enum class WireMode {
+		Json,
+		Binary
 	};
 
-	struct net_thread_data
+	struct ClientConnection
 	{
-		std::mutex mutex;
-		bool end = false;
-		bool disconnect = false;
-		Viewer config;
-		bool configChanged = false;
-		char* statusMessage = "";
-		char* errorMessage = "";
-		bool ready = false;
-		bool error = false;
-		std::queue<TimestampedQuaternion> quaternions;
+		SOCKET socket = INVALID_SOCKET;
+		// Tracker sensor this client reports as, fixed for the connection
+		int sensor = 0;
+		WireMode mode = WireMode::Json;
+		StreamFramer framer;
+		uint32_t sendSequence = 0;
+		// Orientation over UDP, matched to this connection by session id and,
+		// from the first datagram that decodes, the address it came from
+		bool udp = false;
+		uint32_t session = 0;
+		bool peerPinned = false;
+		SOCKADDR_IN peer = SOCKADDR_IN();
+		SequenceTracker sequence;
+		int64_t newestDatagramSample = INT64_MIN;
+		// When the data being processed arrived, server clock (microseconds)
+		int64_t receiveTime = 0;
 	};
 
+	struct TransportStats
+	{
+		uint64_t datagrams;
+		uint64_t lost;
+		uint64_t reordered;
+	};
 
+	/// Everything the OSVR side reads for one tracker sensor. The network
+	/// thread is the only writer, on behalf of whichever client holds the
+	/// sensor, so each ring keeps a single producer.
+	struct SensorChannel
+	{
+		SampleRing<TimestampedQuaternion> quaternions;
+		ClockEstimator clock;
+		// Published whole by the network thread and never modified after,
+		// always read and replaced with std::atomic_load / atomic_store
+		std::shared_ptr<const Viewer> config = std::make_shared<const Viewer>();
+		// Bumped after each publish
+		std::atomic<uint64_t> configGeneration{ 0 };
+		std::atomic<bool> configChanged{ false };
+		std::atomic<bool> connected{ false };
+		// Bumped for each new connection to the sensor
+		std::atomic<uint64_t> connectionGeneration{ 0 };
+		std::atomic<uint64_t> datagrams{ 0 };
+		std::atomic<uint64_t> datagramsLost{ 0 };
+		std::atomic<uint64_t> datagramsReordered{ 0 };
+		PipelineMetrics metrics;
+	};
+
+	struct net_thread_data
+	{
+		// Guards the status strings and the listener; neither the sample path
+		// nor config readers take it
+		std::mutex mutex;
+		EventLoop loop;
+		std::atomic<bool> end{ false };
+		std::atomic<bool> disconnect{ false };
+		const char* statusMessage = "";
+		const char* errorMessage = "";
+		// Told whenever the status or a sensor's config changes, under mutex
+		std::function<void()> listener;
+		std::atomic<bool> ready{ false };
+		std::atomic<bool> error{ false };
+		std::atomic<int> clientCount{ 0 };
+		std::vector<std::unique_ptr<SensorChannel>> sensors;
+		bool translateTimestamps = true;
+		wire::BatchConfig batch;
+		SOCKET udpSocket = INVALID_SOCKET;
+		// A fresh session id per UDP handshake
+		std::random_device sessionIds;
+		// Network thread only, one slot per sensor, free while its socket is
+		// INVALID_SOCKET
+		std::vector<ClientConnection> clients;
+		session::SessionWriter recorder;
+		SessionConfig session;
+		std::atomic<bool> replayFinished{ false };
+		// Raw IMU samples, one lane per sensor, flushed after each batch of
+		// network events
+		ImuFusion fusion;
+		std::vector<FusedSample> fused;
+		// Every phone and viewer seen, opened by the network thread and never
+		// by a replay
+		std::string profilePath;
+		ProfileStore profiles;
+	};
 
 	class TrackingServer {
 	public:
-		TrackingServer();
+		TrackingServer(const TrackingConfig& config = TrackingConfig());
 		~TrackingServer();
 
-		Viewer config();
-		bool hasQuaternion();
-		TimestampedQuaternion quaternion();
-
-		bool configChanged();
+		int sensorCount();
+		int clientCount();
+
+		/// The sensor's current viewer, a snapshot that stays valid however
+		/// long it's held. Never blocks.
+		std::shared_ptr<const Viewer> config(int sensor = 0);
+		/// Counts configs published for the sensor, to spot a change without
+		/// consuming configChanged()
+		uint64_t configGeneration(int sensor = 0);
+		bool connected(int sensor = 0);
+		/// Counts connections to the sensor, to spot a different phone taking
+		/// it between two looks
+		uint64_t connectionGeneration(int sensor = 0);
+		bool hasQuaternion(int sensor = 0);
+		bool quaternion(TimestampedQuaternion& q, int sensor = 0);
+		/// Pops everything queued for a sensor, oldest first, in one go.
+		/// Returns the count.
+		size_t drain(std::vector<TimestampedQuaternion>& out, int sensor = 0);
+		uint64_t droppedQuaternions(int sensor = 0);
+		TransportStats transportStats(int sensor = 0);
+		ClockStats clockStats(int sensor = 0);
+		MetricsSnapshot metrics(int sensor = 0);
+
+		bool configChanged(int sensor = 0);
 		bool hasError();
 		bool isReady();
-		char* getError();
-		char* getStatus();
+		const char* getError();
+		const char* getStatus();
 
+		/// Drops every connected client
 		void disconnect();
 
+		/// Replaces polling isReady() and configChanged(): the listener is
+		/// called on the network thread whenever the status or any sensor's
+		/// config changes. It runs under the server's lock, so it should just
+		/// hand off (post a message, notify a condition variable) and never
+		/// call back into the server. Pass nullptr to stop.
+		void setChangeListener(std::function<void()> listener);
+
+		/// True once a replay has fed the whole log through (never when looping)
+		bool replayFinished();
+
 		static void net_thread(net_thread_data& data);
+		static void replay_thread(net_thread_data& data);
 	private:
+		static bool acceptClient(net_thread_data& data, SOCKET listenSocket);
+		static void closeClient(net_thread_data& data, ClientConnection& client);
+		static void updateStatus(net_thread_data& data);
+		static bool receive(net_thread_data& data, ClientConnection& client);
+		static void processLine(net_thread_data& data, ClientConnection& client, std::string_view line);
+		static bool processFrames(net_thread_data& data, ClientConnection& client);
+		static void processFrame(net_thread_data& data, ClientConnection& client, const wire::Header& header, std::string_view payload);
+		static void handshake(net_thread_data& data, ClientConnection& client, const Json::Value& hello);
+		static SOCKET openDatagramSocket();
+		static void receiveDatagrams(net_thread_data& data);
+		static void processDatagram(net_thread_data& data, const char* datagram, size_t length, const SOCKADDR_IN& sender, int64_t receiveTime);
+		static void processDatagramFrames(net_thread_data& data, ClientConnection& client, const char* datagram, size_t length);
+		static void replayRecord(net_thread_data& data, const session::Record& record, int64_t shift);
+		static void applyConfig(net_thread_data& data, ClientConnection& client, const Json::Value& configJson);
+		static void restoreProfile(net_thread_data& data, int sensor, const ProfileStore::Profile& profile);
+		static void publishConfig(net_thread_data& data, int sensor, std::shared_ptr<const Viewer> viewer);
+		static void deliver(net_thread_data& data, ClientConnection& client, TimestampedQuaternion q);
+		static void flushFusion(net_thread_data& data);
+		static void delivered(SensorChannel& channel, const TimestampedQuaternion* samples, size_t count);
+		// Call with data.mutex held
+		static void changed(net_thread_data& data);
+
 		std::thread* m_net_thread;
 		net_thread_data m_net_thread_data;
 
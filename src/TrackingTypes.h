@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+#include "osvr/Util/QuaternionC.h"
+#include "osvr/Util/TimeValueC.h"
+
+namespace OSVRCardboard {
+	struct TimestampedQuaternion {
+		OSVR_Quaternion quaternion;
+		OSVR_TimeValue timestamp;
+	};
+
+	/// One raw reading from a phone's motion sensors, in the head's frame
+	/// as OSVR has it (x right, y up, z back)
+	struct ImuSample {
+		// Microseconds, client clock
+		int64_t timestamp;
+		// Radians per second
+		float gyro[3];
+		// Any unit, only the direction is used
+		float accel[3];
+		// Likewise, and only if hasMagnet
+		float magnet[3];
+		bool hasMagnet;
+	};
+
+	inline int64_t toMicroseconds(const OSVR_TimeValue& timeValue)
+	{
+		return (int64_t)timeValue.seconds * 1000000 + timeValue.microseconds;
+	}
+
+	inline OSVR_TimeValue fromMicroseconds(int64_t microseconds)
+	{
+		OSVR_TimeValue timeValue;
+		timeValue.seconds = microseconds / 1000000;
+		timeValue.microseconds = (OSVR_TimeValue_Microseconds)(microseconds % 1000000);
+		if (timeValue.microseconds < 0) {
+			timeValue.seconds -= 1;
+			timeValue.microseconds += 1000000;
+		}
+		return timeValue;
+	}
+}
\ No newline at end of file
@@ -1,15 +1,141 @@
 #include "Viewer.h"
+#include "Base64.h"
 #include "display_descriptor.h"
 
 #include <json/json.h>
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
 #include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace OSVRCardboard {
-	Viewer::Viewer() {}
+	namespace {
+		/*
+			Phones resend the same config on every reconnect and generation is
+			deterministic, so decoded params and display configs are kept by
+			content. A handful of phones and viewers is all anyone has, so when
+			a cache does fill up it just starts over.
+		*/
+		template <typename T>
+		class ContentCache {
+		public:
+			template <typename Make>
+			std::shared_ptr<const T> get(const std::string& key, Make make)
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					auto found = m_entries.find(key);
+					if (found != m_entries.end()) {
+						return found->second;
+					}
+				}
+
+				// Built outside the lock, two threads racing on a new key just
+				// do the work twice
+				std::shared_ptr<const T> value = make();
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_entries.size() >= VIEWER_CACHE_ENTRIES) {
+					m_entries.clear();
+				}
+				return m_entries.emplace(key, std::move(value)).first->second;
+			}
+
+		private:
+			std::mutex m_mutex;
+			std::unordered_map<std::string, std::shared_ptr<const T>> m_entries;
+		};
+
+		ContentCache<DeviceParams>& deviceCache()
+		{
+			static ContentCache<DeviceParams> cache;
+			return cache;
+		}
+
+		struct GeneratedConfig {
+			std::string text;
+			// Degrees, negative without a fit
+			double inverseError;
+		};
+
+		ContentCache<GeneratedConfig>& displayConfigCache()
+		{
+			static ContentCache<GeneratedConfig> cache;
+			return cache;
+		}
+
+		// The embedded descriptor, parsed once
+		const Json::Value& baseDescriptor()
+		{
+			static const Json::Value descriptor = [] {
+				Json::Value value;
+				Json::Reader reader;
+				reader.parse(display_descriptor, value);
+				return value;
+			}();
+			return descriptor;
+		}
+
+		const std::shared_ptr<const DeviceParams>& noDevice()
+		{
+			static const std::shared_ptr<const DeviceParams> device = std::make_shared<DeviceParams>();
+			return device;
+		}
+
+		// Stands in for the mesh in the Json::Value, and is replaced by the mesh
+		// as text once written: building and styling thousands of tiny Values
+		// costs a thousand times what computing the mesh does
+		const char* MeshPlaceholder = "\"@mono_point_samples@\"";
+
+		// [[screen x, screen y], [texture x, texture y]] per sample; %.9g gives
+		// every float back exactly
+		void appendMeshSamples(std::string& out, const std::vector<MeshSample>& samples)
+		{
+			char text[96];
+			out += '[';
+			for (size_t i = 0; i < samples.size(); i++) {
+				const MeshSample& sample = samples[i];
+				int length = snprintf(text, sizeof(text), "%s[[%.9g,%.9g],[%.9g,%.9g]]", i ? "," : "",
+					sample.screen[0], sample.screen[1], sample.texture[0], sample.texture[1]);
+				out.append(text, length);
+			}
+			out += ']';
+		}
+
+		template <typename T>
+		void appendBytes(std::string& key, const T& value)
+		{
+			key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+	}
+
+	Viewer::Viewer() :
+		m_device(noDevice()),
+		m_device_width(0),
+		m_screen_width(0),
+		m_screen_height(0),
+		m_screen_horizontal(0),
+		m_screen_vertical(0)
+	{
+		// Materialize the descriptor on the thread creating the server, not
+		// the first time someone saves a config
+		baseDescriptor();
+	}
+
 	Viewer::~Viewer() {}
 
-	bool Viewer::parseFromJson(Json::Value config) {
+	bool Viewer::parseFromJson(const Json::Value& config) {
 		if (!config.isMember("viewerParams") ||
 			!config.isMember("deviceWidth") ||
 			!config.isMember("screenWidth") ||
@@ -22,11 +148,19 @@ namespace OSVRCardboard {
 			throw std::bad_alloc();
 		}
 
-		m_viewer_params = config["viewerParams"].asString();
-		std::string deviceString = base64_decode(m_viewer_params);
-		if (!m_device.ParseFromString(deviceString)) {
-			throw std::bad_alloc();
-		}
+		std::string viewerParams = config["viewerParams"].asString();
+		std::shared_ptr<const DeviceParams> device = deviceCache().get(viewerParams, [&viewerParams] {
+			// The params live on their own arena, which the pointer keeps alive
+			std::shared_ptr<google::protobuf::Arena> arena = std::make_shared<google::protobuf::Arena>();
+			const DeviceParams* decoded = decodeViewerParams(viewerParams, arena.get());
+			if (!decoded) {
+				throw std::bad_alloc();
+			}
+			return std::shared_ptr<const DeviceParams>(arena, decoded);
+		});
+
+		m_viewer_params = std::move(viewerParams);
+		m_device = std::move(device);
 		m_device_width = config["deviceWidth"].asFloat();
 		m_screen_width = config["screenWidth"].asFloat();
 		m_screen_height = config["screenHeight"].asFloat();
@@ -37,187 +171,243 @@ namespace OSVRCardboard {
 		return true;
 	}
 
-	std::string Viewer::viewerParams()
+	std::string Viewer::viewerParams() const
 	{
 		return m_viewer_params;
 	}
 
-	std::string Viewer::name()
+	std::string Viewer::name() const
 	{
 		return m_device_name;
 	}
 
-	std::string Viewer::vendor()
+	std::string Viewer::vendor() const
 	{
-		return m_device.vendor();
+		return m_device->vendor();
 	}
 
-	std::string Viewer::model()
+	std::string Viewer::model() const
 	{
-		return m_device.model();
+		return m_device->model();
 	}
 
-	void Viewer::resolution(unsigned long *resolution)
+	void Viewer::resolution(unsigned long *resolution) const
 	{
 		resolution[0] = m_screen_vertical;
 		resolution[1] = m_screen_horizontal;
 		resolution[2] = 32;
 	}
 
-	std::string Viewer::displayConfig()
+	// Everything displayConfig() depends on
+	std::string Viewer::cacheKey(const DistortionMeshConfig& mesh, const InverseDistortionConfig& inverse) const
 	{
-		Json::Value config;
-		Json::Reader reader;
-		double degreesPerRadian = 180.0f / 3.14159f;
-
-		reader.parse(display_descriptor, config);
+		std::string key = m_viewer_params;
+		key += '\0';
+		appendBytes(key, m_device_width);
+		appendBytes(key, m_screen_width);
+		appendBytes(key, m_screen_height);
+		appendBytes(key, m_screen_horizontal);
+		appendBytes(key, m_screen_vertical);
+		appendBytes(key, mesh.density);
+		appendBytes(key, inverse.order);
+		appendBytes(key, inverse.samples);
+		return key;
+	}
 
-		if (m_device.has_vendor()) {
-			config["hmd"]["device"]["vendor"] = m_device.vendor();
-		}
-		if (m_device.has_model()) {
-			config["hmd"]["device"]["model"] = m_device.model();
-		}
+	std::string Viewer::displayConfig(const DistortionMeshConfig& mesh, const InverseDistortionConfig& inverse, double* inverseError) const
+	{
+		std::shared_ptr<const GeneratedConfig> generated = displayConfigCache().get(cacheKey(mesh, inverse), [this, &mesh, &inverse] {
+			const DeviceParams& device = *m_device;
+			Json::Value config = baseDescriptor();
+			double degreesPerRadian = 180.0f / 3.14159f;
+			double fitError = -1;
+
+			if (device.has_vendor()) {
+				config["hmd"]["device"]["vendor"] = device.vendor();
+			}
+			if (device.has_model()) {
+				config["hmd"]["device"]["model"] = device.model();
+			}
 
-		config["hmd"]["resolutions"][0]["width"] = m_screen_vertical;
-		config["hmd"]["resolutions"][0]["height"] = m_screen_horizontal;
+			config["hmd"]["resolutions"][0]["width"] = m_screen_vertical;
+			config["hmd"]["resolutions"][0]["height"] = m_screen_horizontal;
 
-		if (m_device.has_inter_lens_distance()) {
-			double center_proj_x = (m_screen_height - m_device.inter_lens_distance()) / m_screen_height;
-			config["hmd"]["eyes"][0]["center_proj_x"] = center_proj_x;
-			config["hmd"]["eyes"][1]["center_proj_x"] = 1.0f - center_proj_x;
+			if (device.has_inter_lens_distance()) {
+				double center_proj_x = (m_screen_height - device.inter_lens_distance()) / m_screen_height;
+				config["hmd"]["eyes"][0]["center_proj_x"] = center_proj_x;
+				config["hmd"]["eyes"][1]["center_proj_x"] = 1.0f - center_proj_x;
 
-			if (m_device.has_tray_to_lens_distance()) {
-				double fov_left = atan((center_proj_x * m_screen_height / 2) / m_device.tray_to_lens_distance());
-				double fov_right = atan(((1.0f - center_proj_x) * m_screen_height / 2) / m_device.tray_to_lens_distance());
+				if (device.has_tray_to_lens_distance()) {
+					double fov_left = atan((center_proj_x * m_screen_height / 2) / device.tray_to_lens_distance());
+					double fov_right = atan(((1.0f - center_proj_x) * m_screen_height / 2) / device.tray_to_lens_distance());
 
-				config["hmd"]["field_of_view"]["monocular_horizontal"] = (fov_left + fov_right) * degreesPerRadian;
-			}
-		}
-		if (m_device.has_tray_to_lens_distance()) {
-			double center_proj_y = (m_device.tray_to_lens_distance() - ((m_device_width - m_screen_width) / 2)) / m_screen_width;
-
-			if (m_device.has_vertical_alignment()) {
-				switch (m_device.vertical_alignment()) {
-				case DeviceParams::BOTTOM:
-					break;
-				case DeviceParams::TOP:
-					center_proj_y = 1.0f - center_proj_y;
-					break;
-				case DeviceParams::CENTER:
-					center_proj_y = 0.5f;
-					break;
+					config["hmd"]["field_of_view"]["monocular_horizontal"] = (fov_left + fov_right) * degreesPerRadian;
 				}
-
 			}
-			config["hmd"]["eyes"][0]["center_proj_y"] = center_proj_y;
-			config["hmd"]["eyes"][1]["center_proj_y"] = center_proj_y;
+			if (device.has_tray_to_lens_distance()) {
+				double center_proj_y = (device.tray_to_lens_distance() - ((m_device_width - m_screen_width) / 2)) / m_screen_width;
+
+				if (device.has_vertical_alignment()) {
+					switch (device.vertical_alignment()) {
+					case DeviceParams::BOTTOM:
+						break;
+					case DeviceParams::TOP:
+						center_proj_y = 1.0f - center_proj_y;
+						break;
+					case DeviceParams::CENTER:
+						center_proj_y = 0.5f;
+						break;
+					}
 
-			double fov_bottom = atan((center_proj_y * m_screen_width) / m_device.tray_to_lens_distance());
-			double fov_top = atan(((1.0f - center_proj_y) * m_screen_width) / m_device.tray_to_lens_distance());
+				}
+				config["hmd"]["eyes"][0]["center_proj_y"] = center_proj_y;
+				config["hmd"]["eyes"][1]["center_proj_y"] = center_proj_y;
 
-			config["hmd"]["field_of_view"]["monocular_vertical"] = (fov_top + fov_bottom) * degreesPerRadian;
-		}
+				double fov_bottom = atan((center_proj_y * m_screen_width) / device.tray_to_lens_distance());
+				double fov_top = atan(((1.0f - center_proj_y) * m_screen_width) / device.tray_to_lens_distance());
 
-		if (m_device.distortion_coefficients_size()) {
-			Json::Value distortion = Json::Value(Json::arrayValue);
-			distortion.append(0.0f);
-			distortion.append(1.0f);
-			for (int i = 0; i < m_device.distortion_coefficients_size(); i++) {
-				distortion.append(m_device.distortion_coefficients(i));
+				config["hmd"]["field_of_view"]["monocular_vertical"] = (fov_top + fov_bottom) * degreesPerRadian;
 			}
-			config["hmd"]["distortion"]["polynomial_coeffs_red"] = distortion;
-			config["hmd"]["distortion"]["polynomial_coeffs_green"] = distortion;
-			config["hmd"]["distortion"]["polynomial_coeffs_blue"] = distortion;
-		}
-
-		Json::StyledWriter writer;
-
-		return writer.write(config);
-	}
-
-	bool Viewer::hasMagnet()
-	{
-		return m_device.has_magnet();
-	}
-
-/*
-	base64.cpp and base64.h
 
-	Copyright (C) 2004-2008 Ren Nyffenegger
-
-	This source code is provided 'as-is', without any express or implied
-	warranty. In no event will the author be held liable for any damages
-	arising from the use of this software.
+			// Fitting and meshing need the full lens geometry, without it the
+			// coefficients go out as they are
+			bool hasLens = device.has_inter_lens_distance() && device.has_tray_to_lens_distance();
+			EyeLens lens;
+			if (hasLens) {
+				lens.width = m_screen_height / 2;
+				lens.height = m_screen_width;
+				lens.centerX = config["hmd"]["eyes"][0]["center_proj_x"].asDouble();
+				lens.centerY = config["hmd"]["eyes"][0]["center_proj_y"].asDouble();
+				lens.projectionDistance = device.tray_to_lens_distance();
+				lens.screenDistance = device.has_screen_to_lens_distance() ? device.screen_to_lens_distance() : lens.projectionDistance;
+				lens.coefficients.assign(device.distortion_coefficients().begin(), device.distortion_coefficients().end());
+			}
 
-	Permission is granted to anyone to use this software for any purpose,
-	including commercial applications, and to alter it and redistribute it
-	freely, subject to the following restrictions:
+			// A mesh replaces the polynomial outright, RenderManager only ever uses
+			// one distortion, so the inverse fit is only made when there's no mesh
+			bool meshed = mesh.density > 0 && hasLens && device.distortion_coefficients_size();
 
-	1. The origin of this source code must not be misrepresented; you must not
-	claim that you wrote the original source code. If you use this source code
-	in a product, an acknowledgment in the product documentation would be
-	appreciated but is not required.
+			if (device.distortion_coefficients_size() && !meshed) {
+				Json::Value distortion = Json::Value(Json::arrayValue);
+				distortion.append(0.0f);
+				distortion.append(1.0f);
+				for (int i = 0; i < device.distortion_coefficients_size(); i++) {
+					distortion.append(device.distortion_coefficients(i));
+				}
 
-	2. Altered source versions must be plainly marked as such, and must not be
-	misrepresented as being the original source code.
+				if (hasLens) {
+					// Out to the farthest viewport corner from the lens
+					double cornerX = std::max(lens.centerX, 1 - lens.centerX) * lens.width;
+					double cornerY = std::max(lens.centerY, 1 - lens.centerY) * lens.height;
+					double maxRadius = sqrt(cornerX * cornerX + cornerY * cornerY) / lens.screenDistance;
+					InverseDistortion fit = fitInverseDistortion(lens.coefficients, maxRadius, inverse);
+
+					if (!fit.coefficients.empty()) {
+						fitError = atan(fit.maxError) * degreesPerRadian;
+
+						// RenderManager measures r from the centre of projection in units
+						// of distance_scale viewports and scales texture coordinates by
+						// poly(r) / r. Screen tan-angles in, and the image's tan-angles,
+						// which differ by the two distances, out.
+						double outScale = lens.projectionDistance / lens.screenDistance;
+						distortion = Json::Value(Json::arrayValue);
+						distortion.append(0.0f);
+						distortion.append(outScale);
+						for (double coefficient : fit.coefficients) {
+							distortion.append(0.0f);
+							distortion.append(coefficient * outScale);
+						}
+						config["hmd"]["distortion"]["distance_scale_x"] = lens.width / lens.screenDistance;
+						config["hmd"]["distortion"]["distance_scale_y"] = lens.height / lens.screenDistance;
+					}
+				}
 
-	3. This notice may not be removed or altered from any source distribution.
+				config["hmd"]["distortion"]["polynomial_coeffs_red"] = distortion;
+				config["hmd"]["distortion"]["polynomial_coeffs_green"] = distortion;
+				config["hmd"]["distortion"]["polynomial_coeffs_blue"] = distortion;
+			}
 
-	Ren Nyffenegger rene.nyffenegger@adp-gmbh.ch
+			std::string eyes;
+			if (meshed) {
+				eyes += '[';
+				for (int eye = 0; eye < 2; eye++) {
+					if (eye) eyes += ',';
+					appendMeshSamples(eyes, generateDistortionMesh(lens, mesh));
+					// The right lens mirrors the left
+					lens.centerX = 1 - lens.centerX;
+				}
+				eyes += ']';
 
-	-----
+				Json::Value distortion = Json::Value(Json::objectValue);
+				distortion["type"] = "mono_point_samples";
+				distortion["mono_point_samples"] = std::string(MeshPlaceholder + 1, strlen(MeshPlaceholder) - 2);
+				config["hmd"]["distortion"] = distortion;
+			}
 
-	Source below has been altered by <steve@nourish.je> to fit the application
-*/
+			Json::StyledWriter writer;
+			std::string written = writer.write(config);
+			if (!eyes.empty()) {
+				written.replace(written.find(MeshPlaceholder), strlen(MeshPlaceholder), eyes);
+			}
+			return std::make_shared<const GeneratedConfig>(GeneratedConfig{ std::move(written), fitError });
+		});
 
-	const std::string Viewer::base64_chars =
-		"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-		"abcdefghijklmnopqrstuvwxyz"
-		"0123456789-_";
+		if (inverseError) {
+			*inverseError = generated->inverseError;
+		}
+		return generated->text;
+	}
 
-	bool Viewer::is_base64(unsigned char c) {
-		return (isalnum(c) || (c == '-') || (c == '_'));
+	bool Viewer::hasMagnet() const
+	{
+		return m_device->has_magnet();
 	}
 
-	std::string Viewer::base64_decode(std::string const& encoded_string) {
-		int in_len = encoded_string.size();
-		int i = 0;
-		int j = 0;
-		int in_ = 0;
-		unsigned char char_array_4[4], char_array_3[3];
-		std::string ret;
-
-		while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-			char_array_4[i++] = encoded_string[in_]; in_++;
-			if (i == 4) {
-				for (i = 0; i <4; i++)
-					char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-				char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-				char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-				char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-				for (i = 0; (i < 3); i++)
-					ret += char_array_3[i];
-				i = 0;
+	bool Viewer::writeDisplayConfig(const std::string& path, const DistortionMeshConfig& mesh, const InverseDistortionConfig& inverse, double* inverseError) const
+	{
+		std::string temporary = path + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			file << displayConfig(mesh, inverse, inverseError);
+			if (!file) {
+				return false;
 			}
 		}
 
-		if (i) {
-			for (j = i; j <4; j++)
-				char_array_4[j] = 0;
-
-			for (j = 0; j <4; j++)
-				char_array_4[j] = base64_chars.find(char_array_4[j]);
+		// Swapped in whole, so nothing ever reads half a file. Windows' rename
+		// won't replace an existing file, and removing it first would leave a
+		// moment with no file at all.
+#ifdef _WIN32
+		return MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+	}
 
-			char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-			char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-			char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+	DeviceParams* Viewer::decodeViewerParams(std::string_view encoded, google::protobuf::Arena* arena)
+	{
+		uint8_t stackBuffer[VIEWER_PARAMS_STACK_SIZE];
+		std::vector<uint8_t> heapBuffer;
+		uint8_t* buffer = stackBuffer;
+		size_t capacity = base64url::maxDecodedLength(encoded.size());
+		if (capacity > sizeof(stackBuffer)) {
+			heapBuffer.resize(capacity);
+			buffer = heapBuffer.data();
+		}
 
-			for (j = 0; (j < i - 1); j++) ret += char_array_3[j];
+		ptrdiff_t length = base64url::decode(encoded, buffer);
+		if (length < 0) {
+			return nullptr;
 		}
 
-		return ret;
+		DeviceParams* params = google::protobuf::Arena::CreateMessage<DeviceParams>(arena);
+		if (!params->ParseFromArray(buffer, (int)length)) {
+			// Owned by the arena if there is one
+			if (!arena) {
+				delete params;
+			}
+			return nullptr;
+		}
+		return params;
 	}
 }
\ No newline at end of file
@@ -1,8 +1,18 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <memory>
 #include <json/json.h>
+#include <google/protobuf/arena.h>
 #include "CardboardDevice.pb.h"
+#include "DistortionMesh.h"
+#include "InverseDistortion.h"
+
+// Distinct phone and viewer combinations remembered before starting over
+#define VIEWER_CACHE_ENTRIES 32
+// Decoded viewer params up to this size never touch the heap
+#define VIEWER_PARAMS_STACK_SIZE 512
 
 namespace OSVRCardboard {
 	class Viewer {
@@ -10,19 +20,35 @@ namespace OSVRCardboard {
 		Viewer();
 		~Viewer();
 
-		bool parseFromJson(Json::Value config);
+		bool parseFromJson(const Json::Value& config);
+
+		std::string name() const;
+		std::string vendor() const;
+		std::string model() const;
+		bool hasMagnet() const;
+		void resolution(unsigned long *resolution) const;
 
-		std::string name();
-		std::string vendor();
-		std::string model();
-		bool hasMagnet();
-		void resolution(unsigned long *resolution);
+		/// A mesh, when mesh.density allows one, takes the place of the
+		/// polynomial distortion and no inverse is fitted. inverseError, if
+		/// given, gets the fitted inverse distortion's max error in degrees,
+		/// negative when nothing was fitted.
+		std::string displayConfig(const DistortionMeshConfig& mesh = DistortionMeshConfig(),
+			const InverseDistortionConfig& inverse = InverseDistortionConfig(), double* inverseError = nullptr) const;
+		/// Writes displayConfig() to a file, replacing it in one go. False if
+		/// it couldn't.
+		bool writeDisplayConfig(const std::string& path, const DistortionMeshConfig& mesh = DistortionMeshConfig(),
+			const InverseDistortionConfig& inverse = InverseDistortionConfig(), double* inverseError = nullptr) const;
 
-		std::string displayConfig();
+		std::string viewerParams() const;
 
-		std::string viewerParams();
+		/// Decodes a QR code's base64url viewer params straight onto an arena,
+		/// nullptr if they don't decode. Bulk tools can reuse one arena and
+		/// Reset() it between batches.
+		static DeviceParams* decodeViewerParams(std::string_view encoded, google::protobuf::Arena* arena);
 	private:
-		DeviceParams m_device;
+		// Decoded viewer params are shared with every Viewer built from the
+		// same phone and viewer, as are display configs, see Viewer.cpp
+		std::shared_ptr<const DeviceParams> m_device;
 		float m_device_width;
 		float m_screen_width;
 		float m_screen_height;
@@ -31,8 +57,6 @@ namespace OSVRCardboard {
 		std::string m_device_name;
 		std::string m_viewer_params;
 
-		static const std::string base64_chars;
-		static inline bool is_base64(unsigned char c);
-		std::string base64_decode(std::string const& encoded_string);
+		std::string cacheKey(const DistortionMeshConfig& mesh, const InverseDistortionConfig& inverse) const;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "WireProtocol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace OSVRCardboard {
+	namespace wire {
+		namespace {
+			const double Sqrt2 = 1.41421356237309505;
+		}
+
+		void putF32(char* out, float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			putU32(out, bits);
+		}
+
+		float getF32(const char* in)
+		{
+			uint32_t bits = getU32(in);
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		DecodeStatus decodeHeader(const char* data, size_t size, Header& header)
+		{
+			if (size < 2) {
+				return DecodeStatus::NeedMore;
+			}
+			if (getU16(data) != OSVR_CARDBOARD_WIRE_MAGIC) {
+				return DecodeStatus::Invalid;
+			}
+			if (size < OSVR_CARDBOARD_WIRE_HEADER_SIZE) {
+				return DecodeStatus::NeedMore;
+			}
+
+			header.version = (uint8_t)data[2];
+			header.type = (uint8_t)data[3];
+			header.length = getU16(data + 4);
+			header.flags = getU16(data + 6);
+			header.sequence = getU32(data + 8);
+
+			if (header.version != OSVR_CARDBOARD_WIRE_VERSION) {
+				return DecodeStatus::Invalid;
+			}
+			if (size < OSVR_CARDBOARD_WIRE_HEADER_SIZE + (size_t)header.length) {
+				return DecodeStatus::NeedMore;
+			}
+			return DecodeStatus::Ok;
+		}
+
+		size_t encodeHeader(char* out, uint8_t type, uint16_t length, uint32_t sequence)
+		{
+			putU16(out, OSVR_CARDBOARD_WIRE_MAGIC);
+			out[2] = (char)OSVR_CARDBOARD_WIRE_VERSION;
+			out[3] = (char)type;
+			putU16(out + 4, length);
+			putU16(out + 6, 0);
+			putU32(out + 8, sequence);
+			return OSVR_CARDBOARD_WIRE_HEADER_SIZE;
+		}
+
+		bool decodeOrientation(const char* payload, size_t length, TimestampedQuaternion& q)
+		{
+			if (length < OrientationPayloadSize) {
+				return false;
+			}
+			osvrQuatSetX(&q.quaternion, getF32(payload));
+			osvrQuatSetY(&q.quaternion, getF32(payload + 4));
+			osvrQuatSetZ(&q.quaternion, getF32(payload + 8));
+			osvrQuatSetW(&q.quaternion, getF32(payload + 12));
+			q.timestamp = fromMicroseconds((int64_t)getU64(payload + 16));
+			return true;
+		}
+
+		size_t encodeOrientation(char* out, uint32_t sequence, const TimestampedQuaternion& q)
+		{
+			char* payload = out + encodeHeader(out, Orientation, OrientationPayloadSize, sequence);
+			putF32(payload, (float)osvrQuatGetX(&q.quaternion));
+			putF32(payload + 4, (float)osvrQuatGetY(&q.quaternion));
+			putF32(payload + 8, (float)osvrQuatGetZ(&q.quaternion));
+			putF32(payload + 12, (float)osvrQuatGetW(&q.quaternion));
+			putU64(payload + 16, (uint64_t)toMicroseconds(q.timestamp));
+			return OSVR_CARDBOARD_WIRE_HEADER_SIZE + OrientationPayloadSize;
+		}
+
+		bool decodeRawImu(const char* payload, size_t length, ImuSample& sample)
+		{
+			if (length < RawImuPayloadSize) {
+				return false;
+			}
+			sample.timestamp = (int64_t)getU64(payload);
+			for (int i = 0; i < 3; i++) {
+				sample.gyro[i] = getF32(payload + 8 + 4 * i);
+				sample.accel[i] = getF32(payload + 20 + 4 * i);
+			}
+			sample.hasMagnet = length >= RawImuMagnetPayloadSize;
+			for (int i = 0; i < 3; i++) {
+				sample.magnet[i] = sample.hasMagnet ? getF32(payload + 32 + 4 * i) : 0.0f;
+			}
+			return true;
+		}
+
+		size_t encodeRawImu(char* out, uint32_t sequence, const ImuSample& sample)
+		{
+			size_t length = sample.hasMagnet ? RawImuMagnetPayloadSize : RawImuPayloadSize;
+			char* payload = out + encodeHeader(out, RawImu, (uint16_t)length, sequence);
+			putU64(payload, (uint64_t)sample.timestamp);
+			for (int i = 0; i < 3; i++) {
+				putF32(payload + 8 + 4 * i, sample.gyro[i]);
+				putF32(payload + 20 + 4 * i, sample.accel[i]);
+				if (sample.hasMagnet) {
+					putF32(payload + 32 + 4 * i, sample.magnet[i]);
+				}
+			}
+			return OSVR_CARDBOARD_WIRE_HEADER_SIZE + length;
+		}
+
+		uint64_t packQuaternion(const OSVR_Quaternion& q, int componentBits)
+		{
+			double components[4] = { osvrQuatGetW(&q), osvrQuatGetX(&q), osvrQuatGetY(&q), osvrQuatGetZ(&q) };
+			int largest = 0;
+			for (int i = 1; i < 4; i++) {
+				if (fabs(components[i]) > fabs(components[largest])) largest = i;
+			}
+			// q and -q are the same rotation, so the largest can always be positive
+			double sign = components[largest] < 0 ? -1 : 1;
+
+			const double scale = (double)((1 << componentBits) - 1);
+			uint64_t packed = (uint64_t)largest;
+			for (int i = 0; i < 4; i++) {
+				if (i == largest) continue;
+				double unit = (sign * components[i] * Sqrt2 + 1) / 2;
+				packed = (packed << componentBits) | (uint64_t)std::min(std::max(unit * scale + 0.5, 0.0), scale);
+			}
+			return packed;
+		}
+
+		OSVR_Quaternion unpackQuaternion(uint64_t packed, int componentBits)
+		{
+			const uint64_t mask = ((uint64_t)1 << componentBits) - 1;
+			const double scale = (double)mask;
+			int largest = (int)((packed >> (3 * componentBits)) & 3);
+
+			double components[4];
+			double sum = 0;
+			int shift = 2 * componentBits;
+			for (int i = 0; i < 4; i++) {
+				if (i == largest) continue;
+				components[i] = (((packed >> shift) & mask) / scale * 2 - 1) / Sqrt2;
+				sum += components[i] * components[i];
+				shift -= componentBits;
+			}
+			components[largest] = sqrt(std::max(0.0, 1 - sum));
+
+			OSVR_Quaternion q;
+			osvrQuatSetW(&q, components[0]);
+			osvrQuatSetX(&q, components[1]);
+			osvrQuatSetY(&q, components[2]);
+			osvrQuatSetZ(&q, components[3]);
+			return q;
+		}
+
+		bool BatchReader::open(const char* payload, size_t length)
+		{
+			m_read = m_count = 0;
+			if (length < OrientationBatchHeaderSize) {
+				return false;
+			}
+			size_t count = (uint8_t)payload[8];
+			int bits = (uint8_t)payload[9];
+			if (count == 0 || (bits != 32 && bits != 48) ||
+				length < OrientationBatchHeaderSize + count * (2 + bits / 8))
+			{
+				return false;
+			}
+			m_time = (int64_t)getU64(payload);
+			m_count = count;
+			m_bits = bits;
+			m_next = payload + OrientationBatchHeaderSize;
+			return true;
+		}
+
+		bool BatchReader::next(TimestampedQuaternion& q)
+		{
+			if (m_read == m_count) {
+				return false;
+			}
+			m_time += getU16(m_next);
+			uint64_t packed = getU32(m_next + 2);
+			if (m_bits == 48) {
+				packed |= (uint64_t)getU16(m_next + 6) << 32;
+			}
+			q.quaternion = unpackQuaternion(packed, m_bits == 48 ? 15 : 10);
+			q.timestamp = fromMicroseconds(m_time);
+			m_next += 2 + m_bits / 8;
+			m_read++;
+			return true;
+		}
+
+		BatchWriter::BatchWriter(const BatchConfig& config) : m_config(config)
+		{
+			m_config.maxSamples = std::min(std::max(m_config.maxSamples, 1), OSVR_CARDBOARD_BATCH_MAX_SAMPLES);
+			if (m_config.bits != 48) m_config.bits = 32;
+			m_sample_size = 2 + m_config.bits / 8;
+		}
+
+		bool BatchWriter::add(const TimestampedQuaternion& q)
+		{
+			int64_t time = toMicroseconds(q.timestamp);
+			if (m_count == (size_t)m_config.maxSamples) {
+				return false;
+			}
+			if (m_count == 0) {
+				m_first = m_last = time;
+			}
+			else if (time < m_last || time - m_last > 0xFFFF) {
+				return false;
+			}
+
+			char* sample = m_payload + OrientationBatchHeaderSize + m_count * m_sample_size;
+			putU16(sample, (uint16_t)(time - m_last));
+			uint64_t packed = packQuaternion(q.quaternion, m_config.bits == 48 ? 15 : 10);
+			putU32(sample + 2, (uint32_t)packed);
+			if (m_config.bits == 48) {
+				putU16(sample + 6, (uint16_t)(packed >> 32));
+			}
+			m_last = time;
+			m_count++;
+			return true;
+		}
+
+		bool BatchWriter::ready(int64_t now) const
+		{
+			return m_count == (size_t)m_config.maxSamples ||
+				(m_count > 0 && now - m_first >= (int64_t)(m_config.maxDelay * 1e6));
+		}
+
+		size_t BatchWriter::flush(char* out, uint32_t sequence)
+		{
+			if (m_count == 0) {
+				return 0;
+			}
+			putU64(m_payload, (uint64_t)m_first);
+			m_payload[8] = (char)m_count;
+			m_payload[9] = (char)m_config.bits;
+			size_t length = OrientationBatchHeaderSize + m_count * m_sample_size;
+
+			size_t header = encodeHeader(out, OrientationBatch, (uint16_t)length, sequence);
+			memcpy(out + header, m_payload, length);
+			m_count = 0;
+			return header + length;
+		}
+
+		size_t BatchWriter::maxFrameSize() const
+		{
+			return OSVR_CARDBOARD_WIRE_HEADER_SIZE + OrientationBatchHeaderSize + m_config.maxSamples * m_sample_size;
+		}
+
+		bool decodeClockSyncRequest(const char* payload, size_t length, int64_t& clientTime)
+		{
+			if (length < ClockSyncRequestPayloadSize) {
+				return false;
+			}
+			clientTime = (int64_t)getU64(payload);
+			return true;
+		}
+
+		size_t encodeClockSyncRequest(char* out, uint32_t sequence, int64_t clientTime)
+		{
+			char* payload = out + encodeHeader(out, ClockSyncRequest, ClockSyncRequestPayloadSize, sequence);
+			putU64(payload, (uint64_t)clientTime);
+			return OSVR_CARDBOARD_WIRE_HEADER_SIZE + ClockSyncRequestPayloadSize;
+		}
+
+		size_t encodeClockSyncReply(char* out, uint32_t sequence, int64_t clientTime, int64_t serverTime)
+		{
+			char* payload = out + encodeHeader(out, ClockSyncReply, ClockSyncReplyPayloadSize, sequence);
+			putU64(payload, (uint64_t)clientTime);
+			putU64(payload + 8, (uint64_t)serverTime);
+			return OSVR_CARDBOARD_WIRE_HEADER_SIZE + ClockSyncReplyPayloadSize;
+		}
+
+		bool decodeClockSyncReply(const char* payload, size_t length, int64_t& clientTime, int64_t& serverTime)
+		{
+			if (length < ClockSyncReplyPayloadSize) {
+				return false;
+			}
+			clientTime = (int64_t)getU64(payload);
+			serverTime = (int64_t)getU64(payload + 8);
+			return true;
+		}
+
+		bool decodeClockSyncResult(const char* payload, size_t length, int64_t& clientSend, int64_t& serverTime, int64_t& clientReceive)
+		{
+			if (length < ClockSyncResultPayloadSize) {
+				return false;
+			}
+			clientSend = (int64_t)getU64(payload);
+			serverTime = (int64_t)getU64(payload + 8);
+			clientReceive = (int64_t)getU64(payload + 16);
+			return true;
+		}
+
+		size_t encodeClockSyncResult(char* out, uint32_t sequence, int64_t clientSend, int64_t serverTime, int64_t clientReceive)
+		{
+			char* payload = out + encodeHeader(out, ClockSyncResult, ClockSyncResultPayloadSize, sequence);
+			putU64(payload, (uint64_t)clientSend);
+			putU64(payload + 8, (uint64_t)serverTime);
+			putU64(payload + 16, (uint64_t)clientReceive);
+			return OSVR_CARDBOARD_WIRE_HEADER_SIZE + ClockSyncResultPayloadSize;
+		}
+	}
+}
\ No newline at end of file
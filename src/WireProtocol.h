@@ -0,0 +1,225 @@
+#pragma once
+
+#include "TrackingTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#define OSVR_CARDBOARD_WIRE_MAGIC 0x4243
+#define OSVR_CARDBOARD_WIRE_VERSION 1
+#define OSVR_CARDBOARD_WIRE_HEADER_SIZE 12
+#define OSVR_CARDBOARD_WIRE_MAX_PAYLOAD 0xFFFF
+#define OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE 4
+#define OSVR_CARDBOARD_BATCH_MAX_SAMPLES 255
+
+/*
+	Binary framing, negotiated per connection. A client that wants it sends the
+	JSON line
+
+		{"protocol":"binary","version":1}
+
+	and the server answers with the same object (or {"protocol":"json"} if it
+	can't) before switching. From then on every message in both directions is a
+	frame: a fixed header followed by a type specific payload, all little-endian.
+
+		offset  size  field
+		0       2     magic, 0x4243 ("CB")
+		2       1     version
+		3       1     message type
+		4       2     payload length in bytes
+		6       2     flags, reserved (0)
+		8       4     sequence number, per sender and connection
+
+	A binary client can also ask for its orientation reports to go over UDP by
+	adding "transport":"udp" to the handshake. If the server agrees, the reply
+	carries "transport":"udp", the UDP "port" and a "session" id, drawn at
+	random for each handshake. Each datagram is then the 4 byte session id
+	followed by one or more Orientation, OrientationBatch or RawImu frames.
+	The first datagram for a session that decodes pins it to the address and
+	port it came from; datagrams from anywhere else are ignored.
+	Everything else (config, clock sync) stays on the TCP connection, and
+	datagrams that arrive late or out of order are dropped, not delivered.
+
+	Adding "batch":true to the handshake asks for the server's batching policy,
+	which the reply carries as "batch":{"maxSamples":..,"maxDelayMs":..,
+	"bits":..}. The client then packs orientations into OrientationBatch frames
+	(over TCP or UDP), flushing a frame once it holds maxSamples or its first
+	sample is maxDelayMs old:
+
+		offset  size  field
+		0       8     int64 base timestamp (microseconds, client clock)
+		8       1     sample count, 1 to 255
+		9       1     bits per quaternion, 32 or 48
+		10            per sample: uint16 microseconds since the previous sample
+		              (the base for the first), then the quaternion
+
+	Quaternions are "smallest three" encoded: the index of the largest
+	component in the top 2 bits, then the other three, each in
+	[-1/sqrt(2), 1/sqrt(2)], as 10 (32 bit) or 15 (48 bit) bit unsigned values;
+	the largest is made positive and rebuilt from the unit length. Samples more
+	than 65535us apart go in separate frames.
+*/
+
+namespace OSVRCardboard {
+	namespace wire {
+		enum MessageType : uint8_t {
+			// float x, y, z, w; int64 timestamp (microseconds, client clock)
+			Orientation = 1,
+			// int64 client time (microseconds)
+			ClockSyncRequest = 2,
+			// int64 client time; int64 server time (microseconds)
+			ClockSyncReply = 3,
+			// UTF-8 JSON config object, as sent in text mode
+			Config = 4,
+			// int64 client send time; int64 server time from the reply; int64
+			// client receive time, i.e. a ClockSyncReply echoed back
+			ClockSyncResult = 5,
+			// int64 timestamp (microseconds, client clock); float gyro x, y, z
+			// (rad/s); float accel x, y, z; optionally float magnet x, y, z.
+			// Fused into an orientation on the server.
+			RawImu = 6,
+			// Several orientations, delta timestamps and quantized quaternions,
+			// see above
+			OrientationBatch = 7
+		};
+
+		enum class DecodeStatus {
+			Ok,
+			NeedMore,
+			Invalid
+		};
+
+		struct Header {
+			uint8_t version;
+			uint8_t type;
+			uint16_t length;
+			uint16_t flags;
+			uint32_t sequence;
+		};
+
+		const size_t OrientationPayloadSize = 24;
+		const size_t ClockSyncRequestPayloadSize = 8;
+		const size_t ClockSyncReplyPayloadSize = 16;
+		const size_t ClockSyncResultPayloadSize = 24;
+		const size_t RawImuPayloadSize = 32;
+		const size_t RawImuMagnetPayloadSize = 44;
+		const size_t OrientationBatchHeaderSize = 10;
+
+		/// Flush policy for OrientationBatch frames, chosen by the server and
+		/// sent to batching clients in the handshake reply
+		struct BatchConfig {
+			int maxSamples = 16;
+			// Seconds
+			double maxDelay = 0.005;
+			// 32 or 48
+			int bits = 32;
+		};
+
+		/// Validates and decodes the header at the start of data. NeedMore means
+		/// the header or its payload hasn't fully arrived yet.
+		DecodeStatus decodeHeader(const char* data, size_t size, Header& header);
+		size_t encodeHeader(char* out, uint8_t type, uint16_t length, uint32_t sequence);
+
+		bool decodeOrientation(const char* payload, size_t length, TimestampedQuaternion& q);
+		size_t encodeOrientation(char* out, uint32_t sequence, const TimestampedQuaternion& q);
+
+		bool decodeRawImu(const char* payload, size_t length, ImuSample& sample);
+		size_t encodeRawImu(char* out, uint32_t sequence, const ImuSample& sample);
+
+		/// Walks the samples of an OrientationBatch payload in order, without
+		/// copying them anywhere first
+		class BatchReader {
+		public:
+			/// False if the payload is malformed
+			bool open(const char* payload, size_t length);
+			size_t count() const { return m_count; }
+			/// False once every sample has been read
+			bool next(TimestampedQuaternion& q);
+
+		private:
+			const char* m_next = nullptr;
+			size_t m_count = 0;
+			size_t m_read = 0;
+			int m_bits = 32;
+			int64_t m_time = 0;
+		};
+
+		/// Client side: gathers orientations and writes them out as
+		/// OrientationBatch frames under a BatchConfig
+		class BatchWriter {
+		public:
+			BatchWriter(const BatchConfig& config = BatchConfig());
+
+			/// False if the sample can't join the current batch (it's full, or
+			/// the sample is too far from the last in time); flush and add again
+			bool add(const TimestampedQuaternion& q);
+			bool empty() const { return m_count == 0; }
+			/// True once the batch is full, or its first sample has waited
+			/// maxDelay by now (microseconds, client clock)
+			bool ready(int64_t now) const;
+			/// Writes the batch as one frame and starts a new one. out needs
+			/// room for maxFrameSize().
+			size_t flush(char* out, uint32_t sequence);
+			size_t maxFrameSize() const;
+
+		private:
+			BatchConfig m_config;
+			size_t m_sample_size;
+			char m_payload[OrientationBatchHeaderSize + OSVR_CARDBOARD_BATCH_MAX_SAMPLES * 8];
+			size_t m_count = 0;
+			int64_t m_first = 0;
+			int64_t m_last = 0;
+		};
+
+		/// Smallest three quaternion packing, 10 or 15 bits per component
+		uint64_t packQuaternion(const OSVR_Quaternion& q, int componentBits);
+		OSVR_Quaternion unpackQuaternion(uint64_t packed, int componentBits);
+
+		bool decodeClockSyncRequest(const char* payload, size_t length, int64_t& clientTime);
+		size_t encodeClockSyncRequest(char* out, uint32_t sequence, int64_t clientTime);
+		size_t encodeClockSyncReply(char* out, uint32_t sequence, int64_t clientTime, int64_t serverTime);
+		bool decodeClockSyncReply(const char* payload, size_t length, int64_t& clientTime, int64_t& serverTime);
+
+		bool decodeClockSyncResult(const char* payload, size_t length, int64_t& clientSend, int64_t& serverTime, int64_t& clientReceive);
+		size_t encodeClockSyncResult(char* out, uint32_t sequence, int64_t clientSend, int64_t serverTime, int64_t clientReceive);
+
+		// Little-endian field access, independent of host byte order and alignment
+		inline void putU16(char* out, uint16_t value)
+		{
+			out[0] = (char)(value & 0xFF);
+			out[1] = (char)(value >> 8);
+		}
+
+		inline void putU32(char* out, uint32_t value)
+		{
+			for (int i = 0; i < 4; i++) out[i] = (char)((value >> (8 * i)) & 0xFF);
+		}
+
+		inline void putU64(char* out, uint64_t value)
+		{
+			for (int i = 0; i < 8; i++) out[i] = (char)((value >> (8 * i)) & 0xFF);
+		}
+
+		inline uint16_t getU16(const char* in)
+		{
+			return (uint16_t)((uint8_t)in[0] | ((uint8_t)in[1] << 8));
+		}
+
+		inline uint32_t getU32(const char* in)
+		{
+			uint32_t value = 0;
+			for (int i = 3; i >= 0; i--) value = (value << 8) | (uint8_t)in[i];
+			return value;
+		}
+
+		inline uint64_t getU64(const char* in)
+		{
+			uint64_t value = 0;
+			for (int i = 7; i >= 0; i--) value = (value << 8) | (uint8_t)in[i];
+			return value;
+		}
+
+		void putF32(char* out, float value);
+		float getF32(const char* in);
+	}
+}
\ No newline at end of file
@@ -1,7 +1,7 @@
 // Internal Includes
 #include <osvr/PluginKit/PluginKit.h>
 #include <osvr/PluginKit/AnalogInterfaceC.h>
-#include "SettingsWindow.h"
+#include "TrackerDevice.h"
 
 
 // Library/third-party includes
@@ -24,7 +24,7 @@ class HardwareDetection {
 
             /// Create our device object
             osvr::pluginkit::registerObjectForDeletion(
-                ctx, new OSVRCardboard::SettingsWindow(ctx));
+                ctx, new OSVRCardboard::TrackerDevice(ctx));
         }
         return OSVR_RETURN_SUCCESS;
     }
@@ -0,0 +1,259 @@
+/*
+	Writes the OSVR display config for every combination of Cardboard viewer
+	and phone, the same file the settings window's Save button writes, for
+	provisioning many machines at once. Combinations are spread across every
+	core.
+
+		cardboard_display_configs --viewers FILE --phones FILE --out DIR [options]
+
+		--viewers FILE   viewer params, the base64url payload from each viewer's
+		                 QR code, one per line (blank lines and lines starting
+		                 with # are skipped)
+		--phones FILE    JSON array of phones, each an object with the fields
+		                 the app sends: deviceName, deviceWidth, screenWidth,
+		                 screenHeight (metres), screenHorizontal, screenVertical
+		                 (pixels)
+		--out DIR        existing directory to write into
+		--mesh DENSITY   include a distortion mesh with DENSITY points per side
+		                 (0, no mesh)
+		--order N        order of the fitted inverse distortion polynomial (4),
+		                 unused with --mesh, which replaces the polynomial
+		--threads N      worker threads (one per core)
+
+	Files are named VVVV-PPPP-<viewer>-<phone>.json, VVVV and PPPP being the
+	viewer's line and phone's array index (from 0), so the same inputs always
+	give the same names. Exits with status 1 if any combination fails and 2 on
+	bad arguments or inputs.
+*/
+
+#include "Viewer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	struct Options {
+		const char* viewers = nullptr;
+		const char* phones = nullptr;
+		const char* out = nullptr;
+		DistortionMeshConfig mesh;
+		InverseDistortionConfig inverse;
+		int threads = 0;
+	};
+
+	struct ViewerEntry {
+		std::string params;
+		std::string name;
+	};
+
+	bool parseOptions(int argc, char** argv, Options& options)
+	{
+		// Meshes are only wanted on request here, unlike in the plugin
+		options.mesh.density = 0;
+		// Parallel over combinations already, one thread per mesh
+		options.mesh.threads = 1;
+
+		for (int i = 1; i < argc; i++) {
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!value) {
+				fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+				return false;
+			}
+			i++;
+
+			if (!strcmp(arg, "--viewers")) options.viewers = value;
+			else if (!strcmp(arg, "--phones")) options.phones = value;
+			else if (!strcmp(arg, "--out")) options.out = value;
+			else if (!strcmp(arg, "--mesh")) options.mesh.density = atoi(value);
+			else if (!strcmp(arg, "--order")) options.inverse.order = atoi(value);
+			else if (!strcmp(arg, "--threads")) options.threads = atoi(value);
+			else {
+				fprintf(stderr, "Unknown option: %s\n", arg);
+				return false;
+			}
+		}
+
+		if (!options.viewers || !options.phones || !options.out) {
+			fprintf(stderr, "--viewers, --phones and --out are required\n");
+			return false;
+		}
+		if (options.mesh.density < 0 || options.inverse.order < 1 || options.threads < 0) {
+			fprintf(stderr, "--mesh, --order and --threads can't be negative\n");
+			return false;
+		}
+		options.inverse.samples = std::max(options.inverse.samples, options.inverse.order + 1);
+		if (options.threads == 0) {
+			options.threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		return true;
+	}
+
+	// Letters and digits kept, runs of anything else become one dash
+	std::string fileNamePart(const std::string& text)
+	{
+		std::string part;
+		for (char c : text) {
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+				part += c;
+			}
+			else if (!part.empty() && part.back() != '-') {
+				part += '-';
+			}
+		}
+		while (!part.empty() && part.back() == '-') {
+			part.pop_back();
+		}
+		return part.empty() ? "unnamed" : part;
+	}
+
+	// Every payload is decoded up front, so bad ones are reported by line
+	// rather than failing every combination they're in
+	bool loadViewers(const char* path, std::vector<ViewerEntry>& viewers)
+	{
+		std::ifstream file(path);
+		if (!file) {
+			fprintf(stderr, "Can't read %s\n", path);
+			return false;
+		}
+
+		google::protobuf::Arena arena;
+		std::string line;
+		int number = 0;
+		bool ok = true;
+		while (std::getline(file, line)) {
+			number++;
+			while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+				line.pop_back();
+			}
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+
+			DeviceParams* params = Viewer::decodeViewerParams(line, &arena);
+			if (!params) {
+				fprintf(stderr, "%s:%d: not a viewer params payload\n", path, number);
+				ok = false;
+				continue;
+			}
+			viewers.push_back(ViewerEntry{ line, fileNamePart(params->vendor() + " " + params->model()) });
+		}
+		return ok;
+	}
+
+	bool loadPhones(const char* path, std::vector<Json::Value>& phones)
+	{
+		std::ifstream file(path);
+		Json::Value json;
+		Json::Reader reader;
+		if (!file || !reader.parse(file, json) || !json.isArray()) {
+			fprintf(stderr, "%s isn't a JSON array of phones\n", path);
+			return false;
+		}
+
+		const char* numbers[] = { "deviceWidth", "screenWidth", "screenHeight", "screenHorizontal", "screenVertical" };
+		bool ok = true;
+		for (Json::ArrayIndex i = 0; i < json.size(); i++) {
+			const Json::Value& phone = json[i];
+			if (!phone.isObject() || !phone["deviceName"].isString()) {
+				fprintf(stderr, "%s: phone %u has no deviceName string\n", path, i);
+				ok = false;
+				continue;
+			}
+			for (const char* field : numbers) {
+				if (!phone[field].isNumeric()) {
+					fprintf(stderr, "%s: phone %u has no numeric %s\n", path, i, field);
+					ok = false;
+					break;
+				}
+			}
+			phones.push_back(phone);
+		}
+		return ok;
+	}
+
+	void generate(const Options& options, const std::vector<ViewerEntry>& viewers, const std::vector<Json::Value>& phones,
+		std::atomic<size_t>& next, std::atomic<size_t>& failed)
+	{
+		const size_t total = viewers.size() * phones.size();
+		Viewer viewer;
+		char prefix[48];
+
+		for (size_t combination = next++; combination < total; combination = next++) {
+			size_t v = combination / phones.size();
+			size_t p = combination % phones.size();
+
+			Json::Value config = phones[p];
+			config["viewerParams"] = viewers[v].params;
+			config["protocolVersion"] = 1;
+
+			snprintf(prefix, sizeof(prefix), "%04zu-%04zu-", v, p);
+			std::string path = std::string(options.out) + "/" + prefix + viewers[v].name + "-" +
+				fileNamePart(phones[p]["deviceName"].asString()) + ".json";
+
+			try {
+				viewer.parseFromJson(config);
+				std::string displayConfig = viewer.displayConfig(options.mesh, options.inverse);
+
+				std::ofstream file(path, std::ios::binary);
+				file << displayConfig;
+				if (!file) {
+					fprintf(stderr, "Can't write %s\n", path.c_str());
+					failed++;
+				}
+			}
+			catch (const std::bad_alloc&) {
+				fprintf(stderr, "Bad viewer %zu or phone %zu\n", v, p);
+				failed++;
+			}
+			catch (const Json::Exception& e) {
+				fprintf(stderr, "Bad viewer %zu or phone %zu: %s\n", v, p, e.what());
+				failed++;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	std::vector<ViewerEntry> viewers;
+	std::vector<Json::Value> phones;
+	if (!parseOptions(argc, argv, options) ||
+		!loadViewers(options.viewers, viewers) ||
+		!loadPhones(options.phones, phones))
+	{
+		return 2;
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	std::atomic<size_t> next{ 0 };
+	std::atomic<size_t> failed{ 0 };
+	std::vector<std::thread> workers;
+	for (int i = 0; i < options.threads; i++) {
+		workers.emplace_back(generate, std::cref(options), std::cref(viewers), std::cref(phones), std::ref(next), std::ref(failed));
+	}
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	size_t total = viewers.size() * phones.size();
+	printf("%zu viewer(s) x %zu phone(s): %zu display config(s) in %.2f s on %d thread(s)", viewers.size(), phones.size(),
+		total - failed, seconds, options.threads);
+	if (failed) {
+		printf(", %zu failed", (size_t)failed);
+	}
+	printf("\n");
+	return failed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,604 @@
+/*
+	Headless stand-in for the phone app, for load and latency testing without
+	a phone. Each emulated phone connects over TCP and speaks the app's text
+	protocol: a viewerParams config object on connect, orientation lines at the
+	sample rate and {"s":..,"m":..} clock sync requests once a second. With
+	--batch it speaks the binary protocol instead, packing orientations into
+	OrientationBatch frames under the flush policy the server hands out. With
+	--udp the binary protocol's orientations go over UDP in the session the
+	server hands out, while config and clock sync stay on TCP.
+
+	By default the tool runs its own TrackingServer and drains it like the
+	plugin's update callback does, so it can report end-to-end latency from
+	the moment a sample is taken to the moment it reaches the tracker sink.
+	With --host it loads an external server instead and only the send side and
+	clock sync round trips can be reported.
+
+		cardboard_phone_emulator [options]
+
+		--phones N         concurrent phones (1)
+		--rate HZ          samples per second per phone, 60 to 2000 (200)
+		--duration S       seconds to stream for (5)
+		--coalesce N       samples per write, as a phone batching packets does (1)
+		--random-coalesce  vary each write between 1 and --coalesce samples
+		--batch            send OrientationBatch frames, one write per frame
+		                   (--coalesce is ignored)
+		--udp              send orientations as datagrams, one Orientation
+		                   frame each or, with --batch, one OrientationBatch
+		                   frame each (--coalesce is ignored)
+		--motion FILE      replay the orientations in a recorded stream of
+		                   JSON lines instead of synthetic head motion
+		--host ADDRESS     load the server at ADDRESS instead of an in-process one
+		--record FILE      record the in-process server's session log to FILE,
+		                   for replay later
+		--max-p99-ms MS    exit with status 1 if the p99 latency exceeds MS
+		--max-drop-rate R  exit with status 1 if more than this fraction of
+		                   samples is dropped or lost
+
+	Exits with status 2 on bad arguments or if the phones can't connect.
+*/
+
+#include "TrackingServer.h"
+#include "OrientationParser.h"
+#include "Quaternion.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace OSVRCardboard;
+
+namespace {
+	// Google Cardboard I/O 2015, as the app sends it after scanning the QR code
+	const char* CardboardViewerParams = "CgZHb29nbGUSEkNhcmRib2FyZCBJL08gMjAxNR2ZuxY9JbbzfT0qEAAASEIAAEhCAABIQgAASEJYADUpXA89OggeZnw-MCKFPlAAYAM";
+
+	struct Options {
+		int phones = 1;
+		double rate = 200;
+		double duration = 5;
+		int coalesce = 1;
+		bool randomCoalesce = false;
+		bool batch = false;
+		bool udp = false;
+		const char* motion = nullptr;
+		const char* host = nullptr;
+		const char* record = nullptr;
+		double maxP99 = -1;
+		double maxDropRate = -1;
+	};
+
+	struct PhoneStats {
+		uint64_t sent = 0;
+		uint64_t writes = 0;
+		std::vector<double> clockSyncRoundTrips;
+		bool connected = false;
+	};
+
+	bool parseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++) {
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+			if (!strcmp(arg, "--random-coalesce")) {
+				options.randomCoalesce = true;
+				continue;
+			}
+			if (!strcmp(arg, "--batch")) {
+				options.batch = true;
+				continue;
+			}
+			if (!strcmp(arg, "--udp")) {
+				options.udp = true;
+				continue;
+			}
+			if (!value) {
+				fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+				return false;
+			}
+			i++;
+
+			if (!strcmp(arg, "--phones")) options.phones = atoi(value);
+			else if (!strcmp(arg, "--rate")) options.rate = atof(value);
+			else if (!strcmp(arg, "--duration")) options.duration = atof(value);
+			else if (!strcmp(arg, "--coalesce")) options.coalesce = atoi(value);
+			else if (!strcmp(arg, "--motion")) options.motion = value;
+			else if (!strcmp(arg, "--host")) options.host = value;
+			else if (!strcmp(arg, "--record")) options.record = value;
+			else if (!strcmp(arg, "--max-p99-ms")) options.maxP99 = atof(value);
+			else if (!strcmp(arg, "--max-drop-rate")) options.maxDropRate = atof(value);
+			else {
+				fprintf(stderr, "Unknown option: %s\n", arg);
+				return false;
+			}
+		}
+
+		if (options.phones < 1 || options.phones > TS_MAX_SENSORS) {
+			fprintf(stderr, "--phones must be between 1 and %d\n", TS_MAX_SENSORS);
+			return false;
+		}
+		if (options.rate < 60 || options.rate > 2000) {
+			fprintf(stderr, "--rate must be between 60 and 2000\n");
+			return false;
+		}
+		if (options.coalesce < 1 || options.duration <= 0) {
+			fprintf(stderr, "--coalesce and --duration must be positive\n");
+			return false;
+		}
+		return true;
+	}
+
+	// Orientations to replay, in order, looping
+	std::vector<OSVR_Quaternion> loadMotion(const Options& options)
+	{
+		std::vector<OSVR_Quaternion> motion;
+
+		if (options.motion) {
+			std::ifstream file(options.motion);
+			for (std::string line; std::getline(file, line);) {
+				ParsedLine parsed = parseLine(line);
+				if (parsed.type == LineType::Orientation) {
+					motion.push_back(parsed.sample.quaternion);
+				}
+			}
+			return motion;
+		}
+
+		// 10 seconds of slow yaw and pitch at the sample rate
+		int count = (int)(10 * options.rate);
+		for (int i = 0; i < count; i++) {
+			double t = i / options.rate;
+			double yaw = 0.6 * sin(2 * 3.14159 * 0.3 * t);
+			double pitch = 0.2 * sin(2 * 3.14159 * 0.7 * t);
+			double cy = cos(yaw / 2), sy = sin(yaw / 2), cp = cos(pitch / 2), sp = sin(pitch / 2);
+			motion.push_back(toOsvr(Quat{ cp * cy, sp * cy, cp * sy, -sp * sy }));
+		}
+		return motion;
+	}
+
+	SOCKET connectPhone(const char* host)
+	{
+		SOCKADDR_IN address = SOCKADDR_IN();
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(OSVR_CARDBOARD_PORT);
+		if (host && inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+			fprintf(stderr, "Bad address: %s\n", host);
+			return INVALID_SOCKET;
+		}
+
+		// The in-process server may still be starting up
+		for (int attempt = 0; attempt < 100; attempt++) {
+			SOCKET phone = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (phone == INVALID_SOCKET) break;
+			// A real phone's samples don't wait on the previous one's ack
+			if (connect(phone, (SOCKADDR*)&address, sizeof(address)) != SOCKET_ERROR &&
+				net::setNoDelay(phone))
+			{
+				return phone;
+			}
+			closesocket(phone);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return INVALID_SOCKET;
+	}
+
+	bool sendAll(SOCKET phone, const std::string& data)
+	{
+		size_t sent = 0;
+		while (sent < data.size()) {
+			int result = net::send(phone, data.data() + sent, (int)(data.size() - sent));
+			if (result == SOCKET_ERROR) {
+				if (net::wouldBlock()) continue;
+				return false;
+			}
+			sent += result;
+		}
+		return true;
+	}
+
+	// Asks for the binary protocol, with batching and the server's flush policy
+	// and/or a UDP session as the options say. The socket is still blocking,
+	// and the reply line is read a byte at a time so nothing after it is
+	// consumed.
+	bool binaryHandshake(SOCKET phone, const Options& options, wire::BatchConfig& config, uint32_t& session, int& port)
+	{
+		std::string hello = std::string("{\"protocol\":\"binary\",\"version\":1,\"batch\":") + (options.batch ? "true" : "false") +
+			(options.udp ? ",\"transport\":\"udp\"" : "") + ",\"deviceName\":\"Phone emulator\"}\n";
+		if (!sendAll(phone, hello)) {
+			return false;
+		}
+		std::string line;
+		char c;
+		while (line.size() < TS_BUFFER_SIZE && recv(phone, &c, 1, 0) == 1 && c != '\n') {
+			line += c;
+		}
+
+		Json::Value reply;
+		Json::Reader reader;
+		if (!reader.parse(line, reply) || !reply.isObject() || reply["protocol"] != "binary") {
+			fprintf(stderr, "Server doesn't do the binary protocol: %s\n", line.c_str());
+			return false;
+		}
+		if (options.udp) {
+			if (reply["transport"] != "udp" || !reply["session"].isUInt() || !reply["port"].isInt()) {
+				fprintf(stderr, "Server doesn't do UDP: %s\n", line.c_str());
+				return false;
+			}
+			session = reply["session"].asUInt();
+			port = reply["port"].asInt();
+		}
+		if (!options.batch) {
+			return true;
+		}
+		if (!reply["batch"].isObject()) {
+			fprintf(stderr, "Server doesn't do batching: %s\n", line.c_str());
+			return false;
+		}
+		const Json::Value& batch = reply["batch"];
+		config.maxSamples = batch.get("maxSamples", config.maxSamples).asInt();
+		config.maxDelay = batch.get("maxDelayMs", config.maxDelay * 1000).asDouble() / 1000;
+		config.bits = batch.get("bits", config.bits).asInt();
+		return true;
+	}
+
+	// Clock sync replies, timed against the request they answer
+	void readReplies(SOCKET phone, StreamFramer& framer, PhoneStats& stats, bool binary)
+	{
+		while (true) {
+			char* buffer = framer.prepare(TS_BUFFER_SIZE);
+			int received = recv(phone, buffer, TS_BUFFER_SIZE, 0);
+			if (received <= 0) break;
+			framer.commit(received);
+
+			if (binary) {
+				wire::Header header;
+				std::string_view payload;
+				while (framer.nextFrame(header, payload) == FrameStatus::Ok) {
+					int64_t clientTime, serverTime;
+					if (header.type == wire::ClockSyncReply &&
+						wire::decodeClockSyncReply(payload.data(), payload.size(), clientTime, serverTime))
+					{
+						OSVR_TimeValue now;
+						osvrTimeValueGetNow(&now);
+						stats.clockSyncRoundTrips.push_back((toMicroseconds(now) - clientTime) / 1000.0);
+					}
+				}
+				continue;
+			}
+
+			// {"s":..,"m":..,"ss":..,"sm":..}, the request's time comes first
+			std::string_view line;
+			while (framer.nextLine(line) == FrameStatus::Ok) {
+				long long seconds;
+				long microseconds;
+				if (2 == sscanf(line.data(), "{\"s\":%lld,\"m\":%ld", &seconds, &microseconds)) {
+					OSVR_TimeValue now;
+					osvrTimeValueGetNow(&now);
+					stats.clockSyncRoundTrips.push_back((toMicroseconds(now) - (seconds * 1000000 + microseconds)) / 1000.0);
+				}
+			}
+		}
+	}
+
+	void phone(const Options& options, const std::vector<OSVR_Quaternion>& motion, int index, std::atomic<bool>& start, PhoneStats& stats)
+	{
+		SOCKET socket = connectPhone(options.host);
+		if (socket == INVALID_SOCKET) {
+			return;
+		}
+		bool binary = options.batch || options.udp;
+		wire::BatchConfig batchConfig;
+		uint32_t session = 0;
+		int port = 0;
+		if (binary && !binaryHandshake(socket, options, batchConfig, session, port)) {
+			net::closeSocket(socket);
+			return;
+		}
+
+		// Datagrams go to wherever the TCP connection went, on the port the
+		// server gave out
+		SOCKET udp = INVALID_SOCKET;
+		if (options.udp) {
+			SOCKADDR_IN server = SOCKADDR_IN();
+			socklen_t length = sizeof(server);
+			udp = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			if (udp == INVALID_SOCKET || getpeername(socket, (SOCKADDR*)&server, &length) == SOCKET_ERROR) {
+				net::closeSocket(socket);
+				return;
+			}
+			server.sin_port = htons((u_short)port);
+			if (connect(udp, (SOCKADDR*)&server, sizeof(server)) == SOCKET_ERROR) {
+				closesocket(udp);
+				net::closeSocket(socket);
+				return;
+			}
+		}
+		net::setNonBlocking(socket);
+		stats.connected = true;
+
+		std::string config = std::string("{\"viewerParams\":\"") + CardboardViewerParams + "\","
+			"\"deviceWidth\":0.0671,\"screenWidth\":0.0585,\"screenHeight\":0.104,"
+			"\"screenHorizontal\":750,\"screenVertical\":1334,"
+			"\"deviceName\":\"Phone emulator\",\"protocolVersion\":1}";
+		std::string write;
+		uint32_t sequence = 0;
+		char frame[OSVR_CARDBOARD_WIRE_HEADER_SIZE + OSVR_CARDBOARD_WIRE_MAX_PAYLOAD];
+		if (binary) {
+			write.append(frame, wire::encodeHeader(frame, wire::Config, (uint16_t)config.size(), sequence++));
+			write += config;
+		}
+		else {
+			write = config + "\n";
+		}
+		sendAll(socket, write);
+		wire::BatchWriter batchWriter(batchConfig);
+
+		while (!start) {
+			std::this_thread::yield();
+		}
+
+		using clock = std::chrono::steady_clock;
+		std::mt19937 random(index);
+		StreamFramer framer;
+		char line[256];
+		auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1 / options.rate));
+		auto begin = clock::now();
+		auto end = begin + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(options.duration));
+		auto nextSample = begin;
+		auto nextClockSync = begin;
+		size_t position = (size_t)index * motion.size() / options.phones;
+		int batch = options.coalesce;
+		int batched = 0;
+
+		// Sample frames go out on the TCP stream, or each in a datagram of its
+		// own numbered apart from the stream's frames
+		uint32_t datagramSequence = 0;
+		uint32_t& sampleSequence = options.udp ? datagramSequence : sequence;
+		char prefix[OSVR_CARDBOARD_DATAGRAM_PREFIX_SIZE];
+		wire::putU32(prefix, session);
+		std::string datagram;
+		auto sendSamples = [&](size_t length) {
+			if (!options.udp) {
+				write.append(frame, length);
+				return;
+			}
+			datagram.assign(prefix, sizeof(prefix));
+			datagram.append(frame, length);
+			// Lost datagrams are the server's to count
+			send(udp, datagram.data(), (int)datagram.size(), 0);
+			stats.writes++;
+		};
+
+		write.clear();
+		while (nextSample < end) {
+			std::this_thread::sleep_until(nextSample);
+
+			OSVR_TimeValue now;
+			osvrTimeValueGetNow(&now);
+			const OSVR_Quaternion& q = motion[position++ % motion.size()];
+
+			if (binary) {
+				stats.sent++;
+				TimestampedQuaternion sample = { q, now };
+				if (!options.batch) {
+					sendSamples(wire::encodeOrientation(frame, sampleSequence++, sample));
+				}
+				else {
+					if (!batchWriter.add(sample)) {
+						sendSamples(batchWriter.flush(frame, sampleSequence++));
+						batchWriter.add(sample);
+					}
+					if (batchWriter.ready(toMicroseconds(now))) {
+						sendSamples(batchWriter.flush(frame, sampleSequence++));
+					}
+				}
+				// Clock sync goes straight out, waiting for a batch would skew it
+				if (nextSample >= nextClockSync) {
+					write.append(frame, wire::encodeClockSyncRequest(frame, sequence++, toMicroseconds(now)));
+					nextClockSync += std::chrono::seconds(1);
+				}
+				if (!write.empty()) {
+					if (!sendAll(socket, write)) break;
+					stats.writes++;
+					write.clear();
+				}
+
+				readReplies(socket, framer, stats, true);
+				nextSample += period;
+				continue;
+			}
+
+			snprintf(line, sizeof(line), "{\"x\":%.9g,\"y\":%.9g,\"z\":%.9g,\"w\":%.9g,\"s\":%lld,\"m\":%ld}\n",
+				osvrQuatGetX(&q), osvrQuatGetY(&q), osvrQuatGetZ(&q), osvrQuatGetW(&q),
+				(long long)now.seconds, (long)now.microseconds);
+			write += line;
+			stats.sent++;
+
+			if (nextSample >= nextClockSync) {
+				snprintf(line, sizeof(line), "{\"s\":%lld,\"m\":%ld}\n", (long long)now.seconds, (long)now.microseconds);
+				write += line;
+				nextClockSync += std::chrono::seconds(1);
+			}
+
+			if (++batched >= batch) {
+				if (!sendAll(socket, write)) break;
+				stats.writes++;
+				write.clear();
+				batched = 0;
+				if (options.randomCoalesce) {
+					batch = std::uniform_int_distribution<int>(1, options.coalesce)(random);
+				}
+			}
+
+			readReplies(socket, framer, stats, false);
+			nextSample += period;
+		}
+
+		if (!batchWriter.empty()) {
+			sendSamples(batchWriter.flush(frame, sampleSequence++));
+		}
+		if (!write.empty() && sendAll(socket, write)) {
+			stats.writes++;
+		}
+
+		// Let the last clock sync reply arrive before hanging up
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		readReplies(socket, framer, stats, binary);
+		if (udp != INVALID_SOCKET) {
+			closesocket(udp);
+		}
+		net::closeSocket(socket);
+	}
+
+	double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		if (sorted.empty()) return 0;
+		return sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * fraction))];
+	}
+
+	void printDistribution(const char* name, std::vector<double>& values)
+	{
+		std::sort(values.begin(), values.end());
+		printf("%-22s p50 %8.3f  p90 %8.3f  p99 %8.3f  p99.9 %8.3f  max %8.3f ms\n", name,
+			percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99),
+			percentile(values, 0.999), values.empty() ? 0 : values.back());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		return 2;
+	}
+	net::startup();
+
+	std::vector<OSVR_Quaternion> motion = loadMotion(options);
+	if (motion.empty()) {
+		fprintf(stderr, "No orientations in %s\n", options.motion);
+		return 2;
+	}
+
+	// Samples are timestamped with the time they're taken and left untranslated,
+	// so the sink sees how long each one took to get through
+	std::unique_ptr<TrackingServer> server;
+	if (!options.host) {
+		TrackingConfig config;
+		config.sensors = options.phones;
+		config.clock.translate = false;
+		if (options.record) {
+			config.session.record = options.record;
+		}
+		server.reset(new TrackingServer(config));
+	}
+
+	std::atomic<bool> start{ false };
+	std::vector<PhoneStats> stats(options.phones);
+	std::vector<std::thread> phones;
+	for (int i = 0; i < options.phones; i++) {
+		phones.emplace_back(phone, std::cref(options), std::cref(motion), i, std::ref(start), std::ref(stats[i]));
+	}
+
+	if (server) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (server->clientCount() < options.phones && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	else {
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	start = true;
+
+	// The sink: drain every sensor at roughly the rate OSVR calls update
+	std::vector<double> latencies;
+	std::vector<TimestampedQuaternion> samples;
+	uint64_t received = 0;
+	auto stop = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(options.duration + 0.5));
+
+	while (std::chrono::steady_clock::now() < stop) {
+		if (server) {
+			for (int sensor = 0; sensor < options.phones; sensor++) {
+				size_t count = server->drain(samples, sensor);
+				OSVR_TimeValue now;
+				osvrTimeValueGetNow(&now);
+				for (size_t i = 0; i < count; i++) {
+					latencies.push_back((toMicroseconds(now) - toMicroseconds(samples[i].timestamp)) / 1000.0);
+				}
+				received += count;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	for (std::thread& thread : phones) {
+		thread.join();
+	}
+
+	uint64_t sent = 0, writes = 0, dropped = 0;
+	int connected = 0;
+	std::vector<double> roundTrips;
+	for (PhoneStats& phone : stats) {
+		sent += phone.sent;
+		writes += phone.writes;
+		connected += phone.connected;
+		roundTrips.insert(roundTrips.end(), phone.clockSyncRoundTrips.begin(), phone.clockSyncRoundTrips.end());
+	}
+	if (connected < options.phones) {
+		fprintf(stderr, "Only %d of %d phones connected\n", connected, options.phones);
+		return 2;
+	}
+
+	if (options.batch || options.udp) {
+		printf("%d phone(s) at %g Hz for %g s, %s%s\n", options.phones, options.rate, options.duration,
+			options.batch ? "batched" : "one sample per frame", options.udp ? " over UDP" : "");
+	}
+	else {
+		printf("%d phone(s) at %g Hz for %g s, %s%d sample(s) per write\n", options.phones, options.rate, options.duration,
+			options.randomCoalesce ? "up to " : "", options.coalesce);
+	}
+	printf("%-22s %llu samples in %llu writes, %.0f samples/s\n", "Sent", (unsigned long long)sent,
+		(unsigned long long)writes, sent / options.duration);
+	printDistribution("Clock sync round trip", roundTrips);
+
+	double dropRate = 0;
+	if (server) {
+		for (int sensor = 0; sensor < options.phones; sensor++) {
+			dropped += server->droppedQuaternions(sensor);
+		}
+		uint64_t lost = sent > received + dropped ? sent - received - dropped : 0;
+		dropRate = sent ? (double)(dropped + lost) / sent : 0;
+
+		printf("%-22s %llu samples, %.0f samples/s\n", "Received", (unsigned long long)received, received / options.duration);
+		printf("%-22s %llu dropped by the queue, %llu lost\n", "Missing", (unsigned long long)dropped, (unsigned long long)lost);
+		printDistribution("Sample to sink", latencies);
+	}
+
+	int status = 0;
+	if (options.maxP99 >= 0 && server && percentile(latencies, 0.99) > options.maxP99) {
+		printf("FAIL: p99 latency above %g ms\n", options.maxP99);
+		status = 1;
+	}
+	if (options.maxDropRate >= 0 && dropRate > options.maxDropRate) {
+		printf("FAIL: drop rate %g above %g\n", dropRate, options.maxDropRate);
+		status = 1;
+	}
+
+	server.reset();
+	net::cleanup();
+	return status;
+}
\ No newline at end of file